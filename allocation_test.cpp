@@ -0,0 +1,272 @@
+#include "gTerminal.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+#endif //_WIN32
+
+/*
+ * Steady state allocation test : once every element reached its size, ingesting lines, updating
+ * the elements, rendering frames and running the event loop must not allocate from the global heap.
+ */
+
+namespace
+{
+
+std::atomic<std::size_t> gAllocationCount{0};
+std::atomic_bool gCounting{false};
+
+void* Allocate(std::size_t size)
+{
+    if (gCounting.load(std::memory_order_relaxed))
+    {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* ptr = std::malloc(size != 0 ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+void* AllocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    if (gCounting.load(std::memory_order_relaxed))
+    {
+        gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto const align = static_cast<std::size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (size + align - 1) / align * align))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+//Frames are discarded
+class NullStreambuf : public std::streambuf
+{
+protected:
+    int_type overflow(int_type c) override
+    {
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn([[maybe_unused]] char const* s, std::streamsize count) override
+    {
+        return count;
+    }
+};
+
+#ifndef _WIN32
+//The event loop drives a terminal on a pseudo terminal, the frames are drained from its master side.
+//Return false when no pseudo terminal is available.
+bool CountEventLoopAllocations(int warmupSteps, int countedSteps, std::size_t& allocations)
+{
+    int const master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        if (master != -1)
+        {
+            close(master);
+        }
+        return false;
+    }
+    int const slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    winsize size{};
+    size.ws_col = 100;
+    size.ws_row = 30;
+    if (slave == -1 || ioctl(master, TIOCSWINSZ, &size) != 0 || fcntl(master, F_SETFL, O_NONBLOCK) != 0)
+    {
+        if (slave != -1)
+        {
+            close(slave);
+        }
+        close(master);
+        return false;
+    }
+
+    bool initialized = false;
+    {
+        gt::Terminal terminal;
+        initialized = terminal.init(slave, slave);
+        if (initialized)
+        {
+            terminal.addElement<gt::TextOutputStream>()->setBufferLimit(100);
+
+            gt::EventLoop loop;
+            loop.setFrameInterval(std::chrono::milliseconds{1});
+            loop.addTerminal(&terminal);
+
+            char buffer[1 << 16];
+            auto const step = [&](int i)
+            {
+                terminal.output("event loop line %d\n", i);
+                loop.runOnce();
+                while (read(master, buffer, sizeof(buffer)) > 0);
+            };
+
+            for (int i=0; i<warmupSteps; ++i)
+            {
+                step(i);
+            }
+            auto const before = gAllocationCount.load();
+            gCounting = true;
+            for (int i=warmupSteps; i<warmupSteps+countedSteps; ++i)
+            {
+                step(i);
+            }
+            gCounting = false;
+            allocations = gAllocationCount.load() - before;
+        }
+    }
+
+    close(slave);
+    close(master);
+    return initialized;
+}
+#endif //_WIN32
+
+} //namespace
+
+void* operator new(std::size_t size) { return Allocate(size); }
+void* operator new[](std::size_t size) { return Allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+int main()
+{
+    constexpr int WarmupSteps = 20000;
+    constexpr int CountedSteps = 20000;
+    constexpr int StepsPerFrame = 10;
+    constexpr uint64_t TableRows = 200;
+
+    NullStreambuf nullBuffer;
+    auto* const oldBuffer = std::cout.rdbuf(&nullBuffer);
+
+    std::size_t allocations = 0;
+    {
+        gt::Terminal terminal;
+
+        auto* root = terminal.getRootRegion();
+        root->addRegion(1)->setElement(terminal.addElement<gt::Banner>("Steady state allocation test with a long banner"));
+
+        auto* body = root->addRegion();
+        body->setDirection(gt::Region::Direction::COLUMNS);
+        auto* mainOutput = terminal.addElement<gt::TextOutputStream>();
+        mainOutput->setBufferLimit(100);
+        body->addRegion()->setElement(mainOutput);
+        auto* sideOutput = terminal.addElement<gt::TextOutputStream>();
+        sideOutput->setBufferLimit(50);
+        sideOutput->setTimestampMode(gt::TextOutputStream::TimestampMode::RELATIVE_PREVIOUS);
+        body->addRegion()->setElement(sideOutput);
+        terminal.setChannelOutput("side", sideOutput);
+
+        auto* table = terminal.addElement<gt::Table>();
+        table->addColumn("id", gt::Table::ColumnType::INTEGER, 6);
+        table->addColumn("host", gt::Table::ColumnType::TEXT, 12);
+        table->addColumn("rate", gt::Table::ColumnType::FLOAT, 8, 1);
+        table->sortBy(2, false);
+        body->addRegion()->setElement(table);
+
+        auto* progress = terminal.addElement<gt::ProgressBar>(100000, "Progress");
+        auto* gauge = terminal.addElement<gt::Gauge>(0.0, 1.0, "Load");
+        auto* sparkline = terminal.addElement<gt::Sparkline>("Rate");
+        sparkline->setSamplePeriod(std::chrono::milliseconds{0});
+        root->addRegion(1)->setElement(progress);
+        root->addRegion(1)->setElement(gauge);
+        root->addRegion(1)->setElement(sparkline);
+
+        gt::CommandRegistry commands;
+        commands.addCommand("ping", [&](gt::CommandRegistry::Arguments const&){ terminal.output("pong\n"); });
+        auto* input = terminal.addElement<gt::TextInputStream>();
+        input->setCommandRegistry(&commands);
+        root->addRegion(1)->setElement(input);
+
+        terminal.setTerminalBufferSize({120, 40});
+
+        auto side = terminal.channel("side");
+        gt::TableBatch batch;
+        for (uint64_t key=0; key<TableRows; ++key)
+        {
+            batch.setInteger(key, 0, static_cast<int64_t>(key));
+            batch.setText(key, 1, "host");
+            batch.setFloat(key, 2, 0.0);
+        }
+        table->apply(batch);
+
+        auto const step = [&](int i)
+        {
+            terminal.output("this is a fairly long log line number %d with some payload text\n", i);
+            side.output("side %d\n", i);
+            progress->_value = static_cast<uint64_t>(i % 100000);
+            gauge->_value = (i % 100) / 100.0;
+            sparkline->_value = i % 37;
+
+            batch.clear();
+            batch.setFloat(static_cast<uint64_t>(i) % TableRows, 2, (i * 7919 % 1000) / 10.0);
+            table->apply(batch);
+
+            if (i % 500 == 0)
+            {
+                for (char c : "ping\n")
+                {
+                    if (c != '\0')
+                    {
+                        terminal.pushKeyEvent({true, 1, 0, 0, c, 0});
+                    }
+                }
+            }
+            if (i % StepsPerFrame == 0)
+            {
+                terminal.update();
+                terminal.render();
+            }
+        };
+
+        for (int i=0; i<WarmupSteps; ++i)
+        {
+            step(i);
+        }
+        gCounting = true;
+        for (int i=WarmupSteps; i<WarmupSteps+CountedSteps; ++i)
+        {
+            step(i);
+        }
+        gCounting = false;
+        allocations = gAllocationCount.load();
+    }
+
+    std::cout.rdbuf(oldBuffer);
+    std::cout << "global heap allocations for " << CountedSteps << " lines and "
+              << CountedSteps / StepsPerFrame << " frames : " << allocations << std::endl;
+
+#ifndef _WIN32
+    constexpr int LoopWarmupSteps = 500;
+    constexpr int LoopCountedSteps = 500;
+    std::size_t loopAllocations = 0;
+    if (CountEventLoopAllocations(LoopWarmupSteps, LoopCountedSteps, loopAllocations))
+    {
+        std::cout << "global heap allocations for " << LoopCountedSteps << " event loop turns : "
+                  << loopAllocations << std::endl;
+        allocations += loopAllocations;
+    }
+    else
+    {
+        std::cout << "no pseudo terminal, the event loop is not tested" << std::endl;
+    }
+#endif //_WIN32
+
+    return allocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+#include "gTerminal.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif //_WIN32
+
+/*
+ * Behavior tests : every failed check is reported with its line, the test fails if any did.
+ */
+
+namespace
+{
+
+int gFailureCount = 0;
+
+void Check(bool condition, char const* expression, int line)
+{
+    if (!condition)
+    {
+        std::cerr << "line " << line << " : check failed : " << expression << std::endl;
+        ++gFailureCount;
+    }
+}
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+[[nodiscard]] bool Contains(std::string_view str, std::string_view part)
+{
+    return str.find(part) != std::string_view::npos;
+}
+
+//Frames are discarded
+class NullStreambuf : public std::streambuf
+{
+protected:
+    int_type overflow(int_type c) override
+    {
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn([[maybe_unused]] char const* s, std::streamsize count) override
+    {
+        return count;
+    }
+};
+
+//Run update() until the predicate is true or a second elapsed
+template<class TPredicate>
+void UpdateUntil(gt::Terminal& terminal, TPredicate predicate)
+{
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{1};
+    while (!predicate() && std::chrono::steady_clock::now() < deadline)
+    {
+        terminal.update();
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+}
+
+//Snapshots read the paint order before the next layout, a removed element must be out of it
+void TestRemovedElementSnapshot()
+{
+    gt::Terminal terminal;
+    terminal.setTerminalBufferSize({80, 10});
+    auto* banner = terminal.addElement<gt::Banner>("removed banner");
+    (void) terminal.addElement<gt::TextOutputStream>();
+    terminal.output("kept line\n");
+    terminal.update();
+    terminal.render();
+
+    std::string frame;
+    terminal.composeSnapshot(frame);
+    CHECK(Contains(frame, "removed banner"));
+
+    CHECK(terminal.removeElement(banner));
+
+    frame.clear();
+    terminal.composeSnapshot(frame);
+    CHECK(!Contains(frame, "removed banner"));
+    CHECK(Contains(frame, "kept line"));
+
+    std::string const path = "behavior_test_snapshot.txt";
+    bool done = false;
+    bool success = false;
+    CHECK(terminal.exportSnapshot(path, gt::Terminal::SnapshotFormat::PLAIN,
+                                  {[](void* context){ *static_cast<bool*>(context) = true; }, &done}, &success));
+    UpdateUntil(terminal, [&]{ return done; });
+    CHECK(done && success);
+
+    std::ifstream file(path);
+    std::string const content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    file.close();
+    std::remove(path.c_str());
+    CHECK(!Contains(content, "removed banner"));
+    CHECK(Contains(content, "kept line"));
+
+#ifndef _WIN32
+    //A new viewer is resynchronized with a snapshot on update()
+    std::string const socketPath = "behavior_test_" + std::to_string(getpid()) + ".sock";
+    CHECK(terminal.startAttachServer(socketPath));
+
+    int const desc = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    CHECK(connect(desc, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    terminal.update();
+
+    std::string received;
+    pollfd pollDesc{desc, POLLIN, 0};
+    char buffer[4096];
+    while (poll(&pollDesc, 1, 100) > 0)
+    {
+        auto const count = read(desc, buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            break;
+        }
+        received.append(buffer, static_cast<std::size_t>(count));
+    }
+    close(desc);
+    terminal.stopAttachServer();
+
+    CHECK(!Contains(received, "removed banner"));
+    CHECK(Contains(received, "kept line"));
+#endif //_WIN32
+}
+
+//The lines written before the filter and the cold lines are not indexed, they must be scanned
+void TestFilter()
+{
+    gt::Terminal terminal;
+    auto* output = terminal.addElement<gt::TextOutputStream>();
+    output->setBufferLimit(100);
+    CHECK(output->enableScrollbackFile(std::filesystem::temp_directory_path().string()));
+
+    std::vector<std::string> lines;
+    auto const write = [&](std::size_t count)
+    {
+        for (std::size_t i=0; i<count; ++i)
+        {
+            auto const number = lines.size();
+            lines.push_back((number % 7 == 0 ? "needle " : "hay ") + std::to_string(number) + '\n');
+            terminal.outputText(lines.back());
+        }
+    };
+    auto const expectMatches = [&](std::string_view pattern)
+    {
+        output->setFilter(pattern);
+        UpdateUntil(terminal, [&]{ return output->isFilterComplete(); });
+        auto const expected = std::count_if(lines.begin(), lines.end(), [&](std::string const& line){
+            return Contains(line, pattern);
+        });
+        CHECK(output->isFilterComplete());
+        CHECK(output->getMatchCount() == static_cast<std::size_t>(expected));
+    };
+
+    write(3000);
+    expectMatches("needle");
+    write(3000);
+    expectMatches("needle");
+    expectMatches("needle 42");
+    output->clearFilter();
+    write(1000);
+    expectMatches("needle 5");
+    CHECK(output->getLineCount() == lines.size());
+}
+
+//A scrollback that can't be written is disabled and reported, the stream stays bounded
+void TestScrollbackFailure()
+{
+    gt::Terminal terminal;
+    auto* output = terminal.addElement<gt::TextOutputStream>();
+    output->setBufferLimit(100);
+    CHECK(output->enableScrollbackFile((std::filesystem::temp_directory_path() / "behavior_test_missing" / "directory").string()));
+
+    std::size_t failureCount = 0;
+    output->_onScrollbackFailure.add([&]{ ++failureCount; });
+    for (int i=0; i<500; ++i)
+    {
+        terminal.output("line %d\n", i);
+    }
+
+    CHECK(failureCount == 1);
+    CHECK(!output->isScrollbackFileEnabled());
+    CHECK(output->getLineCount() == 100);
+    CHECK(Contains(output->getLine(99), "line 499"));
+}
+
+//A truncated or corrupted recording stops the replay without allocating its bogus sizes
+void TestMalformedRecording()
+{
+    std::string const path = (std::filesystem::temp_directory_path() / "behavior_test_recording.gtr").string();
+    {
+        gt::Terminal terminal;
+        (void) terminal.addElement<gt::TextOutputStream>();
+        CHECK(terminal.startRecording(path));
+        terminal.output("first line\n");
+        terminal.channel("side").output("second line\n");
+        terminal.stopRecording();
+    }
+    std::string recording;
+    {
+        std::ifstream file(path, std::ios::binary);
+        recording.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    }
+
+    auto const replay = [&](std::string const& content, bool expectMalformed)
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+        gt::Terminal terminal;
+        (void) terminal.addElement<gt::TextOutputStream>();
+        gt::SessionReplay sessionReplay;
+        CHECK(sessionReplay.open(path));
+        sessionReplay.setSpeed(0.0);
+        sessionReplay.play(terminal);
+        CHECK(sessionReplay.isMalformed() == expectMalformed);
+        return sessionReplay.getEventCount();
+    };
+
+    auto const eventCount = replay(recording, false);
+    CHECK(eventCount >= 3);
+    CHECK(replay(recording.substr(0, recording.size() - 3), true) == eventCount - 1);
+
+    //Header, then an event with a zero delta and an oversized payload
+    std::string const header{gt::SessionReplay::Magic, sizeof(gt::SessionReplay::Magic)};
+    std::string const hugeSize{"\x80\x80\x80\x80\x80\x80\x01", 7};
+    auto const event = [&](gt::SessionReplay::EventType type, std::string const& payload)
+    {
+        return header + static_cast<char>(gt::SessionReplay::Version) + static_cast<char>(type) + '\0' + payload;
+    };
+    CHECK(replay(event(gt::SessionReplay::EventType::OUTPUT, std::string{"\x00", 1} + hugeSize), true) == 0);
+    CHECK(replay(event(gt::SessionReplay::EventType::CHANNEL, hugeSize + std::string{"\x00", 1}), true) == 0);
+    CHECK(replay(event(gt::SessionReplay::EventType::FRAME, hugeSize), true) == 0);
+
+    std::remove(path.c_str());
+}
+
+[[nodiscard]] std::string CursorMove(gt::csi::Cursor from, gt::csi::Cursor to)
+{
+    char buffer[gt::csi::MaxSequenceSize * 2];
+    return {buffer, gt::csi::WriteCursorMove(buffer, from, to)};
+}
+
+//The shortest sequence is chosen, the absolute sequences (CUP, CHA) win the ties
+void TestCursorMove()
+{
+    //Unknown row
+    CHECK(CursorMove({0, 0}, {5, 10}) == "\x1b[5;10H");
+    CHECK(CursorMove({0, 7}, {5, 10}) == "\x1b[5;10H");
+
+    CHECK(CursorMove({5, 10}, {5, 10}).empty());
+    CHECK(CursorMove({5, 10}, {6, 10}) == "\x1b[B");
+    CHECK(CursorMove({5, 10}, {3, 10}) == "\x1b[2A");
+    CHECK(CursorMove({5, 10}, {5, 14}) == "\x1b[4C");
+    CHECK(CursorMove({5, 10}, {5, 9}) == "\x1b[D");
+    CHECK(CursorMove({5, 10}, {5, 8}) == "\x1b[8G");
+    CHECK(CursorMove({5, 10}, {5, 1}) == "\r");
+    CHECK(CursorMove({5, 10}, {6, 1}) == "\x1b[B\r");
+    CHECK(CursorMove({5, 10}, {5, 2}) == "\x1b[2G");
+    CHECK(CursorMove({5, 100}, {5, 20}) == "\x1b[20G");
+
+    //Unknown column : CR + CUF or CHA
+    CHECK(CursorMove({5, 0}, {5, 1}) == "\r");
+    CHECK(CursorMove({5, 0}, {5, 2}) == "\x1b[2G");
+    CHECK(CursorMove({5, 0}, {5, 3}) == "\x1b[3G");
+    CHECK(CursorMove({5, 0}, {6, 1}) == "\x1b[B\r");
+
+    //Ties and long moves use CUP
+    CHECK(CursorMove({1, 1}, {2, 2}) == "\x1b[2;2H");
+    CHECK(CursorMove({1, 1}, {40, 80}) == "\x1b[40;80H");
+    CHECK(CursorMove({30, 5}, {2, 60}) == "\x1b[2;60H");
+}
+
+//Keys of the rows in display order, read window by window
+[[nodiscard]] std::vector<uint64_t> ReadTableOrder(gt::Table& table, std::size_t rows)
+{
+    std::vector<uint64_t> keys;
+    for (std::size_t row=0; row<table.getRowCount(); row+=rows)
+    {
+        table.setScrollRow(row);
+        std::ostringstream stream;
+        table.render(stream);
+        std::istringstream lines(stream.str());
+        std::string line;
+        std::getline(lines, line); //Header
+        while (std::getline(lines, line))
+        {
+            keys.push_back(std::stoull(line));
+        }
+    }
+    table.setScrollRow(0);
+    return keys;
+}
+
+//Rows are sorted by value then key, through full rebuilds, moves, inserts and removals
+void TestTableOrder()
+{
+    constexpr std::size_t Rows = 60;
+
+    gt::Terminal terminal;
+    terminal.setTerminalBufferSize({40, Rows + 1});
+    auto* table = terminal.addElement<gt::Table>();
+    table->addColumn("key", gt::Table::ColumnType::INTEGER, 8);
+    table->addColumn("value", gt::Table::ColumnType::INTEGER, 8);
+    table->sortBy(1, false);
+    terminal.render();
+
+    std::map<uint64_t, int64_t> values;
+    uint32_t seed = 1;
+    auto const random = [&](uint32_t range)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % range;
+    };
+
+    gt::TableBatch batch;
+    auto const set = [&](uint64_t key, int64_t value)
+    {
+        batch.setInteger(key, 0, static_cast<int64_t>(key));
+        batch.setInteger(key, 1, value);
+        values[key] = value;
+    };
+    auto const remove = [&](uint64_t key)
+    {
+        batch.removeRow(key);
+        values.erase(key);
+    };
+    std::vector<uint64_t> expected;
+    auto const checkOrder = [&]
+    {
+        table->apply(batch);
+        batch.clear();
+        terminal.update();
+
+        std::vector<std::pair<int64_t, uint64_t> > rows;
+        for (auto const& value : values)
+        {
+            rows.emplace_back(-value.second, value.first);
+        }
+        std::sort(rows.begin(), rows.end());
+        expected.clear();
+        for (auto const& row : rows)
+        {
+            expected.push_back(row.second);
+        }
+
+        CHECK(table->getRowCount() == values.size());
+        CHECK(ReadTableOrder(*table, Rows) == expected);
+    };
+
+    //Sorted at once, many rows share a value
+    for (uint64_t key=0; key<3000; ++key)
+    {
+        set(key, random(1000));
+    }
+    checkOrder();
+
+    //Moved one by one
+    for (int i=0; i<100; ++i)
+    {
+        set(random(3000), random(1000));
+    }
+    checkOrder();
+
+    //Inserted one by one
+    for (uint64_t key=3000; key<3100; ++key)
+    {
+        set(key, random(1000));
+    }
+    checkOrder();
+
+    //Removed, the blocks left small are merged
+    for (uint64_t key=0; key<3100; ++key)
+    {
+        if (key % 10 != 0)
+        {
+            remove(key);
+        }
+    }
+    checkOrder();
+    for (int i=0; i<20; ++i)
+    {
+        set(random(310) * 10, random(1000));
+    }
+    checkOrder();
+
+    for (std::size_t position : {std::size_t{0}, std::size_t{77}, expected.size() - 1})
+    {
+        CHECK(table->scrollToKey(expected[position]));
+        CHECK(table->getScrollRow() == position);
+    }
+    CHECK(!table->scrollToKey(1));
+}
+
+[[nodiscard]] std::string Complete(gt::CompletionTrie const& trie, std::string str)
+{
+    trie.appendCompletion(trie.find(str), str);
+    return str;
+}
+
+void TestCompletionTrie()
+{
+    gt::CompletionTrie trie;
+    for (auto const* word : {"help", "hello", "helm", "world", "exit"})
+    {
+        CHECK(trie.insert(word, static_cast<uint32_t>(trie.getWordCount())));
+    }
+    CHECK(!trie.insert("help", 9));
+    CHECK(!trie.insert(""));
+    CHECK(trie.getWordCount() == 5);
+    CHECK(trie.getValue("hello") == 1);
+    CHECK(trie.getValue("hel") == gt::CompletionTrie::InvalidValue);
+
+    CHECK(trie.getCandidateCount(trie.find("hel")) == 3);
+    CHECK(Complete(trie, "he") == "hel");
+    CHECK(Complete(trie, "hell") == "hello");
+    CHECK(Complete(trie, "w") == "world");
+    CHECK(Complete(trie, "") == "exit");
+    CHECK(Complete(trie, "x") == "x");
+
+    CHECK(trie.erase("hello"));
+    CHECK(!trie.erase("hello"));
+    CHECK(!trie.erase("hel"));
+    CHECK(trie.getWordCount() == 4);
+    CHECK(trie.find("hell") == gt::CompletionTrie::InvalidNode);
+    CHECK(Complete(trie, "hel") == "helm");
+
+    //A word that prefixes another one
+    CHECK(trie.insert("hel", 7));
+    CHECK(Complete(trie, "he") == "hel");
+    CHECK(trie.erase("hel"));
+    CHECK(trie.getValue("helm") == 2);
+    CHECK(trie.getCandidateCount(trie.find("hel")) == 2);
+
+    //Bytes are ordered as unsigned
+    CHECK(trie.insert("\xc3\xa9t\xc3\xa9", 8));
+    CHECK(trie.insert("ete", 9));
+    CHECK(trie.getValue("\xc3\xa9t\xc3\xa9") == 8);
+    CHECK(Complete(trie, "\xc3") == "\xc3\xa9t\xc3\xa9");
+
+    //Released nodes are reused by the next insertions
+    std::map<std::string, uint32_t> words;
+    trie.clear();
+    CHECK(trie.getWordCount() == 0);
+    uint32_t seed = 7;
+    auto const random = [&](uint32_t range)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % range;
+    };
+    for (uint32_t i=0; i<5000; ++i)
+    {
+        std::string word(1 + random(6), 'a');
+        for (auto& c : word)
+        {
+            c = static_cast<char>('a' + random(3));
+        }
+        if (random(2) == 0)
+        {
+            CHECK(trie.insert(word, i) == words.emplace(word, i).second);
+        }
+        else
+        {
+            CHECK(trie.erase(word) == (words.erase(word) != 0));
+        }
+    }
+    CHECK(trie.getWordCount() == words.size());
+    for (auto const& word : words)
+    {
+        CHECK(trie.getValue(word.first) == word.second);
+    }
+    for (std::string const prefix : {"a", "ab", "cab", "bbb"})
+    {
+        auto const count = std::count_if(words.begin(), words.end(), [&](auto const& word){
+            return word.first.compare(0, prefix.size(), prefix) == 0;
+        });
+        CHECK(trie.getCandidateCount(trie.find(prefix)) == static_cast<std::size_t>(count));
+    }
+}
+
+} //namespace
+
+int main()
+{
+    NullStreambuf nullBuffer;
+    auto* const oldBuffer = std::cout.rdbuf(&nullBuffer);
+
+    TestCursorMove();
+    TestRemovedElementSnapshot();
+    TestTableOrder();
+    TestCompletionTrie();
+    TestFilter();
+    TestScrollbackFailure();
+    TestMalformedRecording();
+
+    std::cout.rdbuf(oldBuffer);
+    std::cout << gFailureCount << " failed checks" << std::endl;
+    return gFailureCount == 0 ? 0 : 1;
+}
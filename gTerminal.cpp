@@ -24,14 +24,46 @@
 #include "gTerminal.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <limits>
+#include <bitset>
+#include <regex>
+#include <charconv>
+#include <numeric>
+#include <fstream>
+#include <thread>
+#include <ctime>
+#include <optional>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GTERMINAL_SSE2
+    #include <emmintrin.h>
+#endif
 
 #ifdef _WIN32
     #define WIN32_LEAN_AND_MEAN
     #include <windows.h>
+    #include <intrin.h>
 #else
     #include <unistd.h>
+    #include <fcntl.h>
     #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <sys/wait.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
     #include <termios.h>
+    #include <poll.h>
+    #include <spawn.h>
+    #include <csignal>
+    #include <cerrno>
+
+extern char** environ;
 #endif
 
 namespace gt
@@ -113,8 +145,7 @@ public:
         {
             if (this->g_buffer[i] == '\n')
             {
-                std::string str(this->g_buffer.data()+pos, i+1-pos);
-                this->g_terminalPtr->output(str);
+                this->g_terminalPtr->output("%.*s", static_cast<int>(i+1-pos), this->g_buffer.data()+pos);
 
                 this->g_buffer[i] = '\0';
                 pos = i+1;
@@ -192,452 +223,5982 @@ private:
     Terminal* g_terminalPtr;
 };
 
-namespace
+//Append everything written to a string
+class StringStreambuf : public std::streambuf
 {
-#ifndef _WIN32
-
-//https://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
-
-termios gOriginalTermios;
+public:
+    explicit StringStreambuf(std::pmr::string& str) :
+            g_str(str)
+    {}
+    ~StringStreambuf() override = default;
 
-[[nodiscard]] bool EnableRawMode(int fd)
-{
-    termios raw{};
-    if ( tcgetattr(fd, &raw) != 0 )
+protected:
+    int_type overflow(int_type c) override
     {
-        return false;
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            this->g_str.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(char const* s, std::streamsize n) override
+    {
+        this->g_str.append(s, static_cast<std::size_t>(n));
+        return n;
     }
 
-    gOriginalTermios = raw;
+private:
+    std::pmr::string& g_str;
+};
 
-    raw.c_lflag &= ~(ECHO); //Disable echo
-    raw.c_lflag &= ~(ICANON); //Disable canonical mode
-    //raw.c_oflag &= ~(OPOST); //Disable post-processing of output
-    raw.c_cc[VMIN] = 0; //Minimum number of bytes of input needed before read() can return
-    raw.c_cc[VTIME] = 0; //Maximum amount of time to wait before read() returns
+/*
+ * Unbuffered stream buffer writing to a terminal device, partial writes are completed.
+ */
+class DescriptorStreambuf : public std::streambuf
+{
+public:
+#ifdef _WIN32
+    explicit DescriptorStreambuf(HANDLE handle) :
+            g_handle(handle)
+    {}
+#else
+    explicit DescriptorStreambuf(int desc) :
+            g_desc(desc)
+    {}
+#endif //_WIN32
+    ~DescriptorStreambuf() override = default;
 
-    if ( tcsetattr(fd, TCSAFLUSH, &raw) != 0 )
+protected:
+    int_type overflow(int_type c) override
     {
-        return false;
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            char const ch = traits_type::to_char_type(c);
+            return this->writeAll(&ch, 1) ? c : traits_type::eof();
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(char const* s, std::streamsize n) override
+    {
+        return this->writeAll(s, static_cast<std::size_t>(n)) ? n : 0;
     }
-    return true;
-}
-
-[[nodiscard]] bool DisableRawMode(int fd)
-{
-    return tcsetattr(fd, TCSAFLUSH, &gOriginalTermios) == 0;
-}
 
+private:
+    [[nodiscard]] bool writeAll(char const* data, std::size_t size) const
+    {
+#ifdef _WIN32
+        while (size != 0)
+        {
+            DWORD written = 0;
+            if (WriteFile(this->g_handle, data, static_cast<DWORD>(size), &written, nullptr) != TRUE)
+            {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+#else
+        while (size != 0)
+        {
+            auto const written = ::write(this->g_desc, data, size);
+            if (written == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    pollfd desc{this->g_desc, POLLOUT, 0};
+                    (void) ::poll(&desc, 1, -1);
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
 #endif //_WIN32
-}//namespace
-
-Terminal::Terminal()
-{
-    this->g_defaultOutputStream = this->g_elements.end();
-    this->g_internalOutputStream.rdbuf(std::cout.rdbuf());
-}
+        return true;
+    }
 
 #ifdef _WIN32
-Terminal::~Terminal()
-{
-    this->restoreStandardOutputStream();
-}
+    HANDLE g_handle;
 #else
-Terminal::~Terminal()
-{
-    this->restoreStandardOutputStream();
-    (void) DisableRawMode(this->g_internalInputHandle._desc);
-}
+    int g_desc;
 #endif //_WIN32
+};
 
-bool Terminal::init()
+/*
+ * Raw mode of a terminal device, the original mode is restored on destruction.
+ * https://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
+ */
+class RawMode
 {
+public:
 #ifdef _WIN32
-    HANDLE stdOutHandle = GetStdHandle(STD_OUTPUT_HANDLE);
-    HANDLE stdInHandle = GetStdHandle(STD_INPUT_HANDLE);
-
-    if (stdOutHandle == INVALID_HANDLE_VALUE ||
-        stdInHandle == INVALID_HANDLE_VALUE)
+    explicit RawMode(HANDLE output) :
+            g_output(output)
+    {}
+    ~RawMode()
     {
-        return false;
+        if (this->g_enabled)
+        {
+            (void) SetConsoleMode(this->g_output, this->g_originalMode);
+        }
     }
 
-    this->g_internalOutputHandle._ptr = stdOutHandle;
-    this->g_internalInputHandle._ptr = stdInHandle;
-
-    CONSOLE_SCREEN_BUFFER_INFO bufferInfo;
-    if (GetConsoleScreenBufferInfo(stdOutHandle, &bufferInfo) != TRUE)
+    [[nodiscard]] bool enable()
     {
-        return false;
-    }
+        if (GetConsoleMode(this->g_output, &this->g_originalMode) != TRUE)
+        {
+            return false;
+        }
 
-    this->g_bufferSize._width = bufferInfo.dwSize.X;
-    this->g_bufferSize._height = bufferInfo.dwSize.Y;
+        (void) SetConsoleOutputCP(CP_UTF8);
 
-    DWORD dwMode;
-    if (GetConsoleMode(stdOutHandle, &dwMode) != TRUE)
-    {
-        return false;
+        this->g_enabled = SetConsoleMode(this->g_output, this->g_originalMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING) != 0;
+        return this->g_enabled;
     }
-
-    dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-
-    return SetConsoleMode(stdOutHandle, dwMode) != 0;
 #else
-    this->g_internalInputHandle._desc = fileno(stdin);
-    this->g_internalOutputHandle._desc = fileno(stdout);
-
-    if (this->g_internalInputHandle._desc == -1 ||
-        this->g_internalOutputHandle._desc == -1)
+    explicit RawMode(int input) :
+            g_input(input)
+    {}
+    ~RawMode()
     {
-        return false;
+        if (this->g_enabled)
+        {
+            (void) tcsetattr(this->g_input, TCSAFLUSH, &this->g_original);
+        }
     }
 
-    winsize w{};
-    if ( ioctl(this->g_internalOutputHandle._desc, TIOCGWINSZ, &w) != 0 )
+    [[nodiscard]] bool enable()
     {
-        return false;
+        if ( tcgetattr(this->g_input, &this->g_original) != 0 )
+        {
+            return false;
+        }
+
+        termios raw = this->g_original;
+        raw.c_lflag &= ~(ECHO); //Disable echo
+        raw.c_lflag &= ~(ICANON); //Disable canonical mode
+        //raw.c_oflag &= ~(OPOST); //Disable post-processing of output
+        raw.c_cc[VMIN] = 0; //Minimum number of bytes of input needed before read() can return
+        raw.c_cc[VTIME] = 0; //Maximum amount of time to wait before read() returns
+
+        this->g_enabled = tcsetattr(this->g_input, TCSAFLUSH, &raw) == 0;
+        return this->g_enabled;
     }
+#endif //_WIN32
 
-    this->g_bufferSize._width = w.ws_col;
-    this->g_bufferSize._height = w.ws_row;
+    RawMode(RawMode const&) = delete;
+    RawMode& operator=(RawMode const&) = delete;
 
-    return EnableRawMode(this->g_internalInputHandle._desc);
-#endif
-}
+private:
+#ifdef _WIN32
+    HANDLE g_output;
+    DWORD g_originalMode{0};
+#else
+    int g_input;
+    termios g_original{};
+#endif //_WIN32
+    bool g_enabled{false};
+};
 
-bool Terminal::redirectStandardOutputStream()
+namespace
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
 
-    if (this->g_newStdoutBuffer != nullptr)
+//The terminal that currently redirects std::cout
+std::atomic<Terminal*> gStandardOutputOwner{nullptr};
+//The std::cout buffer replaced by the last redirection, kept after it is restored
+std::atomic<std::streambuf*> gOriginalStdoutBuffer{nullptr};
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile()
     {
-        return false;
+        this->close();
     }
 
-    this->g_oldStdoutBuffer = std::cout.rdbuf();
-    this->g_newStdoutBuffer = std::make_unique<StreambufRedirect>(this);
-    std::cout.rdbuf(this->g_newStdoutBuffer.get());
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
 
-    return true;
-}
-void Terminal::restoreStandardOutputStream()
-{
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    [[nodiscard]] bool open(std::string const& path, uint64_t size, bool create)
+    {
+        this->close();
 
-    if (this->g_newStdoutBuffer == nullptr)
+#ifdef _WIN32
+        this->g_file = CreateFileA(path.c_str(),
+                                   GENERIC_READ | (create ? GENERIC_WRITE : 0),
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                   create ? CREATE_ALWAYS : OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_TEMPORARY, nullptr);
+        if (this->g_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        this->g_mapping = CreateFileMappingA(this->g_file, nullptr, create ? PAGE_READWRITE : PAGE_READONLY,
+                                             static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF),
+                                             nullptr);
+        if (this->g_mapping == nullptr)
+        {
+            this->close();
+            return false;
+        }
+
+        this->g_data = static_cast<char*>(MapViewOfFile(this->g_mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                                        0, 0, static_cast<SIZE_T>(size)));
+        if (this->g_data == nullptr)
+        {
+            this->close();
+            return false;
+        }
+#else
+        int fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0600);
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        if (create && ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | (create ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+        ::close(fd); //The mapping keeps the file referenced
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        this->g_data = static_cast<char*>(data);
+#endif //_WIN32
+
+        this->g_size = size;
+        return true;
+    }
+    void close()
     {
-        return;
+#ifdef _WIN32
+        if (this->g_data != nullptr)
+        {
+            UnmapViewOfFile(this->g_data);
+        }
+        if (this->g_mapping != nullptr)
+        {
+            CloseHandle(this->g_mapping);
+            this->g_mapping = nullptr;
+        }
+        if (this->g_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(this->g_file);
+            this->g_file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (this->g_data != nullptr)
+        {
+            munmap(this->g_data, this->g_size);
+        }
+#endif //_WIN32
+        this->g_data = nullptr;
+        this->g_size = 0;
     }
 
-    std::cout.rdbuf(this->g_oldStdoutBuffer);
-    this->g_newStdoutBuffer = nullptr;
-    this->g_oldStdoutBuffer = nullptr;
-}
+    [[nodiscard]] inline char* data() const { return this->g_data; }
+    [[nodiscard]] inline bool isOpen() const { return this->g_data != nullptr; }
 
-BufferSize Terminal::getTerminalBufferSize() const
+private:
+    char* g_data{nullptr};
+    uint64_t g_size{0};
+#ifdef _WIN32
+    HANDLE g_file{INVALID_HANDLE_VALUE};
+    HANDLE g_mapping{nullptr};
+#endif //_WIN32
+};
+
+[[nodiscard]] unsigned long GetCurrentProcessIdentifier()
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-    return this->g_bufferSize;
+#ifdef _WIN32
+    return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+    return static_cast<unsigned long>(getpid());
+#endif //_WIN32
 }
 
-void Terminal::clearTerminalBuffer()
+//Monotonic milliseconds, the coarse clocks only read the last tick without any hardware access
+[[nodiscard]] uint64_t GetCoarseTimestamp()
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-    this->g_internalOutputStream << CSI_CURSOR_POSITION(1, 1) << CSI_ERASE_DISPLAY(0) << CSI_ERASE_DISPLAY(3) << std::flush;
-    this->invalidate();
+#ifdef _WIN32
+    return static_cast<uint64_t>(GetTickCount64());
+#else
+    timespec time{};
+    #ifdef CLOCK_MONOTONIC_COARSE
+    (void) clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+    #else
+    (void) clock_gettime(CLOCK_MONOTONIC, &time);
+    #endif //CLOCK_MONOTONIC_COARSE
+    return static_cast<uint64_t>(time.tv_sec) * 1000 + static_cast<uint64_t>(time.tv_nsec) / 1000000;
+#endif //_WIN32
 }
-void Terminal::saveCursorPosition()
+
+//Format a timestamp as the local time of day "HH:MM:SS.mmm"
+void FormatTimeOfDay(char (&buffer)[16], uint64_t timestamp)
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-    this->g_internalOutputStream << CSI_SAVE_CURSOR_POSITION << std::flush;
+    //The wall clock is only read once, timestamps are converted with the offset between the two clocks
+    static auto const gOrigin = std::make_pair(std::chrono::system_clock::now(), GetCoarseTimestamp());
+
+    auto const time = gOrigin.first + std::chrono::milliseconds(static_cast<int64_t>(timestamp - gOrigin.second));
+    auto const milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    auto const seconds = std::chrono::system_clock::to_time_t(time);
+
+    std::tm local{};
+#ifdef _WIN32
+    (void) localtime_s(&local, &seconds);
+#else
+    (void) localtime_r(&seconds, &local);
+#endif //_WIN32
+    std::snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%03d", local.tm_hour, local.tm_min, local.tm_sec,
+                  static_cast<int>((milliseconds % 1000 + 1000) % 1000));
 }
-void Terminal::restoreCursorPosition()
+
+[[nodiscard]] inline unsigned int CountTrailingZeros(uint32_t value)
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-    this->g_internalOutputStream << CSI_RESTORE_CURSOR_POSITION << std::flush;
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(value));
+#endif //_MSC_VER
 }
 
-Element* Terminal::addElement(std::unique_ptr<Element>&& element)
+//Compare the first and last character of the needle against 16 positions at once,
+//only the candidates passing both are verified with memcmp.
+[[nodiscard]] std::size_t FindSubstring(std::string_view haystack, std::string_view needle)
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-
-    auto& ref = this->g_elements.emplace_back(std::move(element));
+    if (needle.empty())
+    {
+        return 0;
+    }
+    if (needle.size() > haystack.size())
+    {
+        return std::string_view::npos;
+    }
+    if (needle.size() == 1)
+    {
+        auto const* found = static_cast<char const*>(std::memchr(haystack.data(), needle.front(), haystack.size()));
+        return found == nullptr ? std::string_view::npos : static_cast<std::size_t>(found - haystack.data());
+    }
 
-    ref->setTerminal(this);
+#ifdef GTERMINAL_SSE2
+    auto const first = _mm_set1_epi8(needle.front());
+    auto const last = _mm_set1_epi8(needle.back());
+    std::size_t const lastOffset = needle.size() - 1;
 
-    if (ref->haveOutputStream() && this->g_defaultOutputStream == this->g_elements.end())
+    std::size_t i = 0;
+    for (; i + lastOffset + 16 <= haystack.size(); i += 16)
     {
-        this->g_defaultOutputStream = this->g_elements.end();
-        --this->g_defaultOutputStream;
+        auto const blockFirst = _mm_loadu_si128(reinterpret_cast<__m128i const*>(haystack.data() + i));
+        auto const blockLast = _mm_loadu_si128(reinterpret_cast<__m128i const*>(haystack.data() + i + lastOffset));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                                          _mm_cmpeq_epi8(last, blockLast))));
+        while (mask != 0)
+        {
+            auto const bit = CountTrailingZeros(mask);
+            if (std::memcmp(haystack.data() + i + bit + 1, needle.data() + 1, needle.size() - 2) == 0)
+            {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
     }
 
-    this->invalidate();
-    return ref.get();
+    auto const tail = haystack.substr(i).find(needle);
+    return tail == std::string_view::npos ? std::string_view::npos : i + tail;
+#else
+    return haystack.find(needle);
+#endif //GTERMINAL_SSE2
 }
 
-void Terminal::update()
+[[nodiscard]] std::size_t GetTextWidth(std::string_view str)
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return static_cast<std::size_t>(std::count_if(str.begin(), str.end(), [](char c){
+        return (static_cast<uint8_t>(c) & 0xC0) != 0x80;
+    }));
+}
 
-#ifdef _WIN32
-    INPUT_RECORD records[10];
-    DWORD read = 0;
+//U+2588 full block followed by the left partial blocks from 1/8 to 7/8
+constexpr char const* gFullBlock = "\xE2\x96\x88";
+constexpr char const* gPartialBlocks[8] = {"", "\xE2\x96\x8F", "\xE2\x96\x8E", "\xE2\x96\x8D",
+                                           "\xE2\x96\x8C", "\xE2\x96\x8B", "\xE2\x96\x8A", "\xE2\x96\x89"};
+//U+2581 to U+2588 lower blocks
+constexpr char const* gLevelBlocks[8] = {"\xE2\x96\x81", "\xE2\x96\x82", "\xE2\x96\x83", "\xE2\x96\x84",
+                                         "\xE2\x96\x85", "\xE2\x96\x86", "\xE2\x96\x87", "\xE2\x96\x88"};
 
-    if (WaitForSingleObject(this->g_internalInputHandle._ptr, 0) != WAIT_OBJECT_0)
+[[nodiscard]] std::size_t ComputeBarEighths(double ratio, std::size_t width)
+{
+    ratio = std::clamp(ratio, 0.0, 1.0);
+    return static_cast<std::size_t>(ratio * static_cast<double>(width * 8));
+}
+
+//Percentage displayed after a progress bar, the text is compared to know if it changed
+void FormatPercent(char (&buffer)[16], double ratio)
+{
+    std::snprintf(buffer, sizeof(buffer), " %5.1f%%", std::clamp(ratio, 0.0, 1.0) * 100.0);
+}
+
+void RenderBar(std::ostream& stream, std::size_t width, std::size_t eighths)
+{
+    std::size_t const full = std::min(eighths / 8, width);
+    for (std::size_t i=0; i<full; ++i)
     {
-        return;
+        stream << gFullBlock;
     }
 
-    auto errOut = ReadConsoleInput(this->g_internalInputHandle._ptr,
-                                   records, sizeof(records)/sizeof(INPUT_RECORD), &read);
-
-    if (errOut == 0)
+    std::size_t used = full;
+    if (full < width && eighths % 8 != 0)
     {
-        return;
+        stream << gPartialBlocks[eighths % 8];
+        ++used;
+    }
+    for (; used<width; ++used)
+    {
+        stream << ' ';
     }
+}
 
-    for (DWORD i=0; i<read; ++i)
+//Append the text truncated or padded to exactly width columns
+void AppendFitted(std::string& str, std::string_view text, std::size_t width, bool rightAlign)
+{
+    std::size_t columns = 0;
+    std::size_t end = 0;
+    for (; end<text.size(); ++end)
     {
-        if (records[i].EventType == KEY_EVENT)
+        if ((static_cast<uint8_t>(text[end]) & 0xC0) != 0x80)
         {
-            KeyEvent keyEvent{records[i].Event.KeyEvent.bKeyDown==TRUE,
-                              records[i].Event.KeyEvent.wRepeatCount,
-                              records[i].Event.KeyEvent.wVirtualKeyCode,
-                              records[i].Event.KeyEvent.wVirtualScanCode,
-                              records[i].Event.KeyEvent.uChar.AsciiChar,
-                              records[i].Event.KeyEvent.dwControlKeyState};
-
-            for (auto& element : this->g_elements)
+            if (columns == width)
             {
-                if (element->haveInputStream())
-                {
-                    element->onKeyInput(keyEvent);
-                }
+                break;
             }
+            ++columns;
         }
-        else if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
-        {
-            BufferSize newSize = {static_cast<BufferSize::ValueType>(records[i].Event.WindowBufferSizeEvent.dwSize.X),
-                                  static_cast<BufferSize::ValueType>(records[i].Event.WindowBufferSizeEvent.dwSize.Y)};
+    }
 
-            if (newSize != this->g_bufferSize)
-            {
-                this->g_bufferSize = newSize;
-                for (auto& element : this->g_elements)
-                {
-                    element->onSizeChanged(this->g_bufferSize);
-                    this->invalidate();
-                }
+    if (rightAlign)
+    {
+        str.append(width - columns, ' ');
+        str.append(text.data(), end);
+    }
+    else
+    {
+        str.append(text.data(), end);
+        str.append(width - columns, ' ');
+    }
+}
+
+/*
+ * Split the rendered content into rows of exactly width visible columns, long lines are wrapped.
+ * SGR sequences are kept (and re-applied on wrapped rows), any other escape sequence is dropped.
+ * The cursor is set to the position following the last visible character,
+ * or to the position of the first save cursor sequence (csi::SaveCursorPosition) when there is one.
+ */
+void LayoutRows(std::string_view content, Rect::ValueType width, std::pmr::vector<std::pmr::string>& rows,
+                Rect::ValueType& cursorColumn, Rect::ValueType& cursorRow)
+{
+    rows.clear();
+    if (width == 0)
+    {
+        cursorColumn = 0;
+        cursorRow = 0;
+        return;
+    }
+
+    auto* const resource = rows.get_allocator().resource();
+    std::pmr::string activeStyle(resource);
+    std::pmr::string row(resource);
+    Rect::ValueType column = 0;
+    bool styled = false;
+    bool marked = false;
+    std::size_t markColumn = 0;
+    std::size_t markRow = 0;
+
+    auto const finishRow = [&](){
+        if (styled)
+        {
+            row += csi::ColorNormal;
+        }
+        row.append(width - column, ' ');
+        rows.push_back(std::move(row));
+        row = activeStyle;
+        styled = !activeStyle.empty();
+        column = 0;
+    };
+    auto const putChar = [&](char c){
+        if (column == width)
+        {
+            finishRow();
+        }
+        row.push_back(c);
+        ++column;
+    };
+
+    for (std::size_t i=0; i<content.size(); ++i)
+    {
+        auto const c = content[i];
+
+        if (c == '\x1b')
+        {
+            if (i+1 < content.size() && content[i+1] == '[')
+            {
+                std::size_t end = i+2;
+                while (end < content.size() && (content[end] < 0x40 || content[end] > 0x7E))
+                {
+                    ++end;
+                }
+                if (end < content.size() && content[end] == 'm')
+                {
+                    auto const sequence = content.substr(i, end-i+1);
+                    row += sequence;
+                    if (sequence == csi::ColorNormal || sequence == csi::Sgr<>)
+                    {
+                        activeStyle.clear();
+                    }
+                    else
+                    {
+                        activeStyle += sequence;
+                        styled = true;
+                    }
+                }
+                else if (!marked && content.substr(i, end-i+1) == csi::SaveCursorPosition)
+                {
+                    marked = true;
+                    markColumn = column == width ? 0 : column;
+                    markRow = column == width ? rows.size() + 1 : rows.size();
+                }
+                i = end;
+            }
+            continue;
+        }
+
+        switch (c)
+        {
+        case '\n':
+            finishRow();
+            break;
+        case '\t':
+            do
+            {
+                putChar(' ');
+            } while (column % 8 != 0 && column != width);
+            break;
+        default:
+            if ((static_cast<uint8_t>(c) & 0xC0) == 0x80)
+            {//UTF-8 continuation byte
+                row.push_back(c);
+            }
+            else if (static_cast<uint8_t>(c) >= 0x20 && c != 0x7F)
+            {
+                putChar(c);
+            }
+            break;
+        }
+    }
+
+    if (column != 0 || row.size() != activeStyle.size())
+    {
+        cursorColumn = column == width ? column-1 : column;
+        cursorRow = static_cast<Rect::ValueType>(std::min<std::size_t>(rows.size(), std::numeric_limits<Rect::ValueType>::max()));
+        finishRow();
+    }
+    else
+    {
+        cursorColumn = 0;
+        cursorRow = static_cast<Rect::ValueType>(std::min<std::size_t>(rows.size(), std::numeric_limits<Rect::ValueType>::max()));
+    }
+
+    if (marked)
+    {
+        cursorColumn = static_cast<Rect::ValueType>(markColumn);
+        cursorRow = static_cast<Rect::ValueType>(std::min<std::size_t>(markRow, std::numeric_limits<Rect::ValueType>::max()));
+    }
+}
+
+}//namespace
+
+namespace csi
+{
+
+namespace
+{
+
+struct DigitPairTable
+{
+    char _data[200];
+
+    constexpr DigitPairTable() :
+            _data{}
+    {
+        for (unsigned int i=0; i<100; ++i)
+        {
+            this->_data[i*2] = static_cast<char>('0' + i/10);
+            this->_data[i*2+1] = static_cast<char>('0' + i%10);
+        }
+    }
+};
+constexpr DigitPairTable DigitPairs{};
+
+[[nodiscard]] std::size_t GetRelativeMoveSize(unsigned int count)
+{
+    return count == 1 ? 3 : 3 + CountDigits(count);
+}
+char* WriteRelativeMove(char* buffer, unsigned int count, char final)
+{
+    *buffer++ = '\x1b';
+    *buffer++ = '[';
+    if (count != 1)
+    {
+        buffer = WriteUnsigned(buffer, count);
+    }
+    *buffer++ = final;
+    return buffer;
+}
+
+}//namespace
+
+char* WriteUnsigned(char* buffer, unsigned int value)
+{
+    //Digits are written 2 by 2 from the end
+    auto* const end = buffer + CountDigits(value);
+    auto* it = end;
+    while (value >= 100)
+    {
+        auto const pair = (value % 100) * 2;
+        value /= 100;
+        *--it = DigitPairs._data[pair + 1];
+        *--it = DigitPairs._data[pair];
+    }
+    if (value >= 10)
+    {
+        *--it = DigitPairs._data[value * 2 + 1];
+        *--it = DigitPairs._data[value * 2];
+    }
+    else
+    {
+        *--it = static_cast<char>('0' + value);
+    }
+    return end;
+}
+char* WriteCursorPosition(char* buffer, unsigned int row, unsigned int column)
+{
+    *buffer++ = '\x1b';
+    *buffer++ = '[';
+    buffer = WriteUnsigned(buffer, row);
+    *buffer++ = ';';
+    buffer = WriteUnsigned(buffer, column);
+    *buffer++ = 'H';
+    return buffer;
+}
+char* WriteSgr(char* buffer, unsigned int attribute)
+{
+    *buffer++ = '\x1b';
+    *buffer++ = '[';
+    buffer = WriteUnsigned(buffer, attribute);
+    *buffer++ = 'm';
+    return buffer;
+}
+char* WriteCursorMove(char* buffer, Cursor from, Cursor to)
+{
+    auto const absoluteSize = 4 + CountDigits(to._row) + CountDigits(to._column);
+    if (from._row == 0)
+    {
+        return WriteCursorPosition(buffer, to._row, to._column);
+    }
+
+    std::size_t const verticalSize = from._row == to._row ? 0 :
+            GetRelativeMoveSize(from._row < to._row ? to._row - from._row : from._row - to._row);
+
+    //Horizontal candidates : CUF/CUB (known column only), CR [+ CUF] and CHA
+    enum { NONE, RELATIVE, RETURN, ABSOLUTE } horizontal = ABSOLUTE;
+    std::size_t horizontalSize = to._column == 1 ? 3 : 3 + CountDigits(to._column);
+    if (from._column == to._column)
+    {
+        horizontal = NONE;
+        horizontalSize = 0;
+    }
+    else
+    {
+        auto const returnSize = to._column == 1 ? 1 : 1 + GetRelativeMoveSize(to._column - 1);
+        if (returnSize < horizontalSize)
+        {
+            horizontal = RETURN;
+            horizontalSize = returnSize;
+        }
+        if (from._column != 0)
+        {
+            auto const relativeSize = GetRelativeMoveSize(from._column < to._column ?
+                                                          to._column - from._column : from._column - to._column);
+            if (relativeSize < horizontalSize)
+            {
+                horizontal = RELATIVE;
+                horizontalSize = relativeSize;
+            }
+        }
+    }
+
+    if (absoluteSize <= verticalSize + horizontalSize)
+    {
+        return WriteCursorPosition(buffer, to._row, to._column);
+    }
+
+    if (from._row < to._row)
+    {
+        buffer = WriteRelativeMove(buffer, to._row - from._row, 'B');
+    }
+    else if (from._row > to._row)
+    {
+        buffer = WriteRelativeMove(buffer, from._row - to._row, 'A');
+    }
+
+    switch (horizontal)
+    {
+    case NONE:
+        break;
+    case RELATIVE:
+        buffer = from._column < to._column ? WriteRelativeMove(buffer, to._column - from._column, 'C') :
+                WriteRelativeMove(buffer, from._column - to._column, 'D');
+        break;
+    case RETURN:
+        *buffer++ = '\r';
+        if (to._column != 1)
+        {
+            buffer = WriteRelativeMove(buffer, to._column - 1, 'C');
+        }
+        break;
+    case ABSOLUTE:
+        *buffer++ = '\x1b';
+        *buffer++ = '[';
+        if (to._column != 1)
+        {
+            buffer = WriteUnsigned(buffer, to._column);
+        }
+        *buffer++ = 'G';
+        break;
+    }
+    return buffer;
+}
+
+}//namespace csi
+
+/*
+ * Hot lines of a TextOutputStream are appended to chunks laid out like the scrollback segments.
+ * A written line is never modified so a snapshot reads the chunks without any lock while the stream
+ * keeps appending to the last one. Chunks are linked from the oldest to the newest, a snapshot keeps
+ * the chain alive from its first chunk.
+ */
+class LineChunk
+{
+public:
+    static constexpr std::size_t LineCapacity = 256;
+    static constexpr std::size_t DataCapacity = 16 * 1024;
+
+    LineChunk(std::size_t firstLine, std::size_t dataCapacity, std::pmr::memory_resource* resource) :
+            g_data(dataCapacity, resource),
+            g_firstLine(firstLine)
+    {}
+    ~LineChunk()
+    {
+        //Unlink the chain iteratively, destroying a long chain recursively would overflow the stack
+        auto next = std::move(this->_next);
+        while (next != nullptr && next.use_count() == 1)
+        {
+            auto following = std::move(next->_next);
+            next = std::move(following);
+        }
+    }
+
+    LineChunk(LineChunk const&) = delete;
+    LineChunk& operator=(LineChunk const&) = delete;
+
+    //Only for a chunk that nothing references anymore
+    void reset(std::size_t firstLine)
+    {
+        this->_next = nullptr;
+        this->g_firstLine = firstLine;
+        this->g_lineCount = 0;
+    }
+
+    [[nodiscard]] bool append(std::string_view line, uint64_t timestamp)
+    {
+        auto const begin = this->g_offsets[this->g_lineCount];
+        if (this->g_lineCount == LineCapacity || line.size() > this->g_data.size() - begin)
+        {
+            return false;
+        }
+
+        std::memcpy(this->g_data.data() + begin, line.data(), line.size());
+        this->g_timestamps[this->g_lineCount] = timestamp;
+        this->g_offsets[this->g_lineCount + 1] = begin + static_cast<uint32_t>(line.size());
+        ++this->g_lineCount;
+        return true;
+    }
+
+    //Lines are absolute identifiers
+    [[nodiscard]] std::string_view getLine(std::size_t line) const
+    {
+        auto const index = line - this->g_firstLine;
+        return {this->g_data.data() + this->g_offsets[index], this->g_offsets[index + 1] - this->g_offsets[index]};
+    }
+    [[nodiscard]] uint64_t getTimestamp(std::size_t line) const
+    {
+        return this->g_timestamps[line - this->g_firstLine];
+    }
+
+    [[nodiscard]] inline std::size_t getFirstLine() const { return this->g_firstLine; }
+    [[nodiscard]] inline std::size_t getLineCount() const { return this->g_lineCount; }
+    [[nodiscard]] inline bool isStandardSize() const { return this->g_data.size() == DataCapacity; }
+
+    std::shared_ptr<LineChunk> _next;
+
+private:
+    std::pmr::vector<char> g_data;
+    uint32_t g_offsets[LineCapacity + 1]{};
+    uint64_t g_timestamps[LineCapacity]{};
+    std::size_t g_firstLine;
+    std::size_t g_lineCount{0};
+};
+
+//The file is removed with the last owner, the scrollback or a snapshot still reading it
+struct ScrollbackSegment
+{
+    ScrollbackSegment() = default;
+    ~ScrollbackSegment()
+    {
+        std::remove(this->_path.c_str());
+    }
+
+    ScrollbackSegment(ScrollbackSegment const&) = delete;
+    ScrollbackSegment& operator=(ScrollbackSegment const&) = delete;
+
+    std::string _path;
+    std::size_t _firstLine{0};
+    std::size_t _lineCount{0}; //Only updated by the writer, a snapshot keeps its own count
+    uint64_t _dataCapacity{0};
+};
+
+/*
+ * A segment file is laid out as the line timestamps and an offset index followed by the line data :
+ * [uint64_t timestamps[SegmentLineCapacity]][uint32_t offsets[SegmentLineCapacity+1]][data ...]
+ * offsets[i] is the start of the line i relative to the data section and offsets[lineCount] is its end.
+ * Only the segment being written and the last segment being read are mapped at any time.
+ */
+class ScrollbackFile
+{
+public:
+    static constexpr std::size_t SegmentLineCapacity = 1 << 16;
+    static constexpr uint64_t SegmentDataCapacity = 32 << 20;
+    static constexpr uint64_t SegmentOffsetsPosition = SegmentLineCapacity * sizeof(uint64_t);
+    static constexpr uint64_t SegmentHeaderSize = SegmentOffsetsPosition + (SegmentLineCapacity + 1) * sizeof(uint32_t);
+
+    explicit ScrollbackFile(std::string directory) :
+            g_directory(std::move(directory))
+    {
+        static std::atomic_uint gInstanceCount{0};
+        this->g_prefix = "gterminal-" + std::to_string(GetCurrentProcessIdentifier()) + '-' +
+                std::to_string(gInstanceCount++) + '-';
+    }
+    ~ScrollbackFile()
+    {
+        this->clear();
+    }
+
+    [[nodiscard]] bool push(std::string_view line, uint64_t timestamp)
+    {
+        if (line.size() > std::numeric_limits<uint32_t>::max())
+        {
+            return false;
+        }
+
+        if (!this->g_writeMap.isOpen() ||
+            this->g_segments.back()->_lineCount == SegmentLineCapacity ||
+            this->getUsedBytes() + line.size() > this->g_segments.back()->_dataCapacity)
+        {
+            if (!this->openSegment(line.size()))
+            {
+                return false;
+            }
+        }
+
+        auto& segment = *this->g_segments.back();
+        auto* offsets = reinterpret_cast<uint32_t*>(this->g_writeMap.data() + SegmentOffsetsPosition);
+        auto const begin = offsets[segment._lineCount];
+
+        reinterpret_cast<uint64_t*>(this->g_writeMap.data())[segment._lineCount] = timestamp;
+        std::memcpy(this->g_writeMap.data() + SegmentHeaderSize + begin, line.data(), line.size());
+        offsets[segment._lineCount + 1] = begin + static_cast<uint32_t>(line.size());
+
+        ++segment._lineCount;
+        ++this->g_lineCount;
+        return true;
+    }
+
+    [[nodiscard]] inline std::size_t getLineCount() const { return this->g_lineCount; }
+
+    //Segments are shared with the snapshots, see OutputSnapshot
+    [[nodiscard]] inline std::vector<std::shared_ptr<ScrollbackSegment> > const& getSegments() const
+    {
+        return this->g_segments;
+    }
+
+    [[nodiscard]] std::string_view getLine(std::size_t index) const
+    {
+        std::size_t line = 0;
+        char const* data = this->mapLine(index, line);
+        if (data == nullptr)
+        {
+            return {};
+        }
+
+        auto const* offsets = reinterpret_cast<uint32_t const*>(data + SegmentOffsetsPosition);
+        return {data + SegmentHeaderSize + offsets[line], offsets[line + 1] - offsets[line]};
+    }
+    [[nodiscard]] uint64_t getTimestamp(std::size_t index) const
+    {
+        std::size_t line = 0;
+        char const* data = this->mapLine(index, line);
+        return data == nullptr ? 0 : reinterpret_cast<uint64_t const*>(data)[line];
+    }
+
+    void clear()
+    {
+        this->g_writeMap.close();
+        this->g_readMap.close();
+        this->g_segments.clear();
+        this->g_lineCount = 0;
+    }
+
+private:
+    //Return the mapped segment containing the line and the index of the line in it
+    [[nodiscard]] char const* mapLine(std::size_t index, std::size_t& line) const
+    {
+        if (index >= this->g_lineCount)
+        {
+            return nullptr;
+        }
+
+        auto it = std::upper_bound(this->g_segments.begin(), this->g_segments.end(), index,
+                                   [](std::size_t value, auto const& segment){
+            return value < segment->_firstLine;
+        });
+        auto const segmentIndex = static_cast<std::size_t>(std::distance(this->g_segments.begin(), it)) - 1;
+        auto const& segment = *this->g_segments[segmentIndex];
+        line = index - segment._firstLine;
+
+        if (segmentIndex + 1 == this->g_segments.size() && this->g_writeMap.isOpen())
+        {
+            return this->g_writeMap.data();
+        }
+        if (this->g_readSegment != segmentIndex || !this->g_readMap.isOpen())
+        {
+            if (!this->g_readMap.open(segment._path, SegmentHeaderSize + segment._dataCapacity, false))
+            {
+                return nullptr;
+            }
+            this->g_readSegment = segmentIndex;
+        }
+        return this->g_readMap.data();
+    }
+
+    [[nodiscard]] uint64_t getUsedBytes() const
+    {
+        auto const* offsets = reinterpret_cast<uint32_t const*>(this->g_writeMap.data() + SegmentOffsetsPosition);
+        return offsets[this->g_segments.back()->_lineCount];
+    }
+
+    [[nodiscard]] bool openSegment(std::size_t minimumCapacity)
+    {
+        this->g_writeMap.close();
+
+        auto segment = std::make_shared<ScrollbackSegment>();
+        //Never reuse a name, a cleared segment can still be read by a snapshot
+        segment->_path = this->g_directory + '/' + this->g_prefix + std::to_string(this->g_segmentNumber++) + ".seg";
+        segment->_firstLine = this->g_lineCount;
+        segment->_dataCapacity = std::max<uint64_t>(SegmentDataCapacity, minimumCapacity);
+
+        if (!this->g_writeMap.open(segment->_path, SegmentHeaderSize + segment->_dataCapacity, true))
+        {
+            return false;
+        }
+
+        this->g_segments.push_back(std::move(segment));
+        return true;
+    }
+
+    std::string g_directory;
+    std::string g_prefix;
+    std::vector<std::shared_ptr<ScrollbackSegment> > g_segments;
+    std::size_t g_segmentNumber{0};
+    std::size_t g_lineCount{0};
+
+    MappedFile g_writeMap;
+    mutable MappedFile g_readMap;
+    mutable std::size_t g_readSegment{0};
+};
+
+/*
+ * Every chunk of ChunkLineCount lines owns a bloom filter of the trigrams it contains,
+ * a substring filter only scans the chunks that can contain all the trigrams of the pattern.
+ * Line identifiers are absolute (they keep growing when lines are dropped from the front).
+ * Lines are only indexed while a filter is active and only the last MaxIndexedChunks chunks keep their bloom,
+ * older lines (the history before the filter, the scrollback file) are scanned directly.
+ */
+class ScrollbackSearch
+{
+public:
+    static constexpr std::size_t ChunkLineCount = 256;
+    static constexpr std::size_t BloomBitCount = 1 << 15;
+    static constexpr std::size_t MaxIndexedChunks = 256;
+    static constexpr std::size_t MaxPatternTrigrams = 8;
+
+    explicit ScrollbackSearch(std::pmr::memory_resource* resource) :
+            g_chunks(resource),
+            g_matches(resource)
+    {}
+
+    void onLineAdded(std::string_view line)
+    {
+        auto const chunk = this->g_lineEnd++ / ChunkLineCount;
+        if (!this->g_active || chunk < this->g_firstChunk)
+        {
+            return;
+        }
+
+        if (chunk - this->g_firstChunk == this->g_chunks.size())
+        {
+            this->g_chunks.emplace_back();
+            if (this->g_chunks.size() > MaxIndexedChunks)
+            {
+                this->g_chunks.pop_front();
+                ++this->g_firstChunk;
+            }
+        }
+
+        auto& bloom = this->g_chunks.back();
+        for (std::size_t i=0; i+2<line.size(); ++i)
+        {
+            bloom.set(HashTrigram(line.data()+i));
+        }
+    }
+    void onLinesDropped(std::size_t count)
+    {
+        this->g_lineBegin += count;
+        while (!this->g_chunks.empty() && (this->g_firstChunk+1) * ChunkLineCount <= this->g_lineBegin)
+        {
+            this->g_chunks.pop_front();
+            ++this->g_firstChunk;
+        }
+
+        while (!this->g_matches.empty() && this->g_matches.front() < this->g_lineBegin)
+        {
+            this->g_matches.pop_front();
+        }
+        this->g_scanPosition = std::max(this->g_scanPosition, this->g_lineBegin);
+    }
+    void reset()
+    {
+        //The lines of the current chunk are dropped, it can be indexed from its start
+        this->g_chunks.clear();
+        this->g_firstChunk = this->g_lineEnd / ChunkLineCount;
+        this->g_lineBegin = this->g_lineEnd;
+        this->g_matches.clear();
+        this->g_candidates.clear();
+        this->g_candidateIndex = 0;
+        this->g_scanPosition = this->g_lineEnd;
+    }
+
+    void setPattern(std::string_view pattern, TextOutputStream::FilterMode mode)
+    {
+        //When the pattern is only extended, the new matches are a subset of the previous ones
+        bool const refine = this->g_active && mode == TextOutputStream::FilterMode::SUBSTRING &&
+                this->g_mode == mode && !this->g_pattern.empty() &&
+                this->g_candidateIndex == this->g_candidates.size() &&
+                pattern.find(this->g_pattern) != std::string_view::npos;
+
+        //The index starts with the next chunk, the lines before it are scanned directly
+        if (!this->g_active)
+        {
+            this->g_chunks.clear();
+            this->g_firstChunk = (this->g_lineEnd + ChunkLineCount - 1) / ChunkLineCount;
+        }
+        this->g_active = true;
+        this->g_pattern = pattern;
+        this->g_mode = mode;
+
+        this->g_trigrams.clear();
+        this->g_regexValid = false;
+        if (mode == TextOutputStream::FilterMode::REGEX)
+        {
+            try
+            {
+                this->g_regex.assign(this->g_pattern, std::regex::ECMAScript | std::regex::optimize);
+                this->g_regexValid = true;
+            }
+            catch (std::regex_error const&)
+            {}
+        }
+        else
+        {
+            for (std::size_t i=0; i+2<pattern.size() && this->g_trigrams.size()<MaxPatternTrigrams; ++i)
+            {
+                this->g_trigrams.push_back(HashTrigram(pattern.data()+i));
+            }
+        }
+
+        this->g_candidateIndex = 0;
+        if (refine)
+        {
+            this->g_candidates.assign(this->g_matches.begin(), this->g_matches.end());
+        }
+        else
+        {
+            this->g_candidates.clear();
+            this->g_scanPosition = this->g_lineBegin;
+        }
+        this->g_matches.clear();
+    }
+    void clearPattern()
+    {
+        this->g_active = false;
+        this->g_chunks.clear();
+        this->g_pattern.clear();
+        this->g_matches.clear();
+        this->g_candidates.clear();
+        this->g_candidateIndex = 0;
+    }
+    [[nodiscard]] inline bool isActive() const { return this->g_active; }
+    [[nodiscard]] inline bool isComplete() const
+    {
+        return this->g_candidateIndex == this->g_candidates.size() && this->g_scanPosition == this->g_lineEnd;
+    }
+    [[nodiscard]] inline std::string const& getPattern() const { return this->g_pattern; }
+    [[nodiscard]] inline TextOutputStream::FilterMode getMode() const { return this->g_mode; }
+    [[nodiscard]] inline std::pmr::deque<std::size_t> const& getMatches() const { return this->g_matches; }
+    [[nodiscard]] inline std::size_t getLineBegin() const { return this->g_lineBegin; }
+
+    //Return true if new matches were found
+    bool advance(TextOutputStream const& stream, std::size_t budget)
+    {
+        auto const matchCount = this->g_matches.size();
+
+        while (this->g_candidateIndex < this->g_candidates.size() && budget > 0)
+        {
+            auto const line = this->g_candidates[this->g_candidateIndex++];
+            --budget;
+            if (line >= this->g_lineBegin && this->match(stream.getLine(line - this->g_lineBegin)))
+            {
+                this->g_matches.push_back(line);
+            }
+        }
+        if (this->g_candidateIndex == this->g_candidates.size())
+        {
+            this->g_candidates.clear();
+            this->g_candidateIndex = 0;
+        }
+        else
+        {
+            return this->g_matches.size() != matchCount;
+        }
+
+        while (this->g_scanPosition < this->g_lineEnd && budget > 0)
+        {
+            --budget;
+
+            auto const chunk = this->g_scanPosition / ChunkLineCount;
+            if (!this->chunkMayMatch(chunk))
+            {
+                this->g_scanPosition = std::min((chunk+1) * ChunkLineCount, this->g_lineEnd);
+                continue;
+            }
+
+            if (this->match(stream.getLine(this->g_scanPosition - this->g_lineBegin)))
+            {
+                this->g_matches.push_back(this->g_scanPosition);
+            }
+            ++this->g_scanPosition;
+        }
+
+        return this->g_matches.size() != matchCount;
+    }
+
+private:
+    using Bloom = std::bitset<BloomBitCount>;
+
+    [[nodiscard]] static inline std::size_t HashTrigram(char const* str)
+    {
+        uint32_t const value = static_cast<uint32_t>(static_cast<uint8_t>(str[0])) |
+                static_cast<uint32_t>(static_cast<uint8_t>(str[1])) << 8 |
+                static_cast<uint32_t>(static_cast<uint8_t>(str[2])) << 16;
+        return (value * 0x9E3779B1u) >> (32 - 15);
+    }
+
+    [[nodiscard]] bool chunkMayMatch(std::size_t chunk) const
+    {
+        if (this->g_trigrams.empty() || chunk < this->g_firstChunk || chunk - this->g_firstChunk >= this->g_chunks.size())
+        {
+            return true;
+        }
+        auto const& bloom = this->g_chunks[chunk - this->g_firstChunk];
+        for (auto trigram : this->g_trigrams)
+        {
+            if (!bloom.test(trigram))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool match(std::string_view line) const
+    {
+        if (this->g_mode == TextOutputStream::FilterMode::REGEX)
+        {
+            return this->g_regexValid && std::regex_search(line.begin(), line.end(), this->g_regex);
+        }
+        return FindSubstring(line, this->g_pattern) != std::string_view::npos;
+    }
+
+    std::pmr::deque<Bloom> g_chunks;
+    std::size_t g_firstChunk{0};
+    std::size_t g_lineBegin{0};
+    std::size_t g_lineEnd{0};
+
+    bool g_active{false};
+    std::string g_pattern;
+    TextOutputStream::FilterMode g_mode{TextOutputStream::FilterMode::SUBSTRING};
+    std::vector<std::size_t> g_trigrams;
+    std::regex g_regex;
+    bool g_regexValid{false};
+
+    std::pmr::deque<std::size_t> g_matches;
+    std::vector<std::size_t> g_candidates;
+    std::size_t g_candidateIndex{0};
+    std::size_t g_scanPosition{0};
+};
+
+class SessionRecorder
+{
+public:
+    static constexpr std::size_t FlushSize = 64 * 1024;
+    static constexpr std::chrono::seconds FlushPeriod{1};
+
+    SessionRecorder() = default;
+    ~SessionRecorder()
+    {
+        this->flush();
+    }
+
+    [[nodiscard]] bool open(std::string const& path)
+    {
+        this->g_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!this->g_file)
+        {
+            return false;
+        }
+        this->g_buffer.append(SessionReplay::Magic, sizeof(SessionReplay::Magic));
+        this->g_buffer.push_back(static_cast<char>(SessionReplay::Version));
+        this->g_last = std::chrono::steady_clock::now();
+        this->g_lastFlush = this->g_last;
+        return true;
+    }
+
+    [[nodiscard]] uint64_t addChannel(std::string_view name)
+    {
+        auto const id = ++this->g_channelCount;
+        this->beginEvent(SessionReplay::EventType::CHANNEL);
+        this->writeVarint(id);
+        this->writeString(name);
+        this->endEvent();
+        return id;
+    }
+    void recordOutput(uint64_t id, std::string_view str)
+    {
+        this->beginEvent(SessionReplay::EventType::OUTPUT);
+        this->writeVarint(id);
+        this->writeString(str);
+        this->endEvent();
+    }
+    void recordKey(KeyEvent const& keyEvent)
+    {
+        this->beginEvent(SessionReplay::EventType::KEY);
+        this->g_buffer.push_back(static_cast<char>(keyEvent._keyDown ? 1 : 0));
+        this->writeVarint(keyEvent._repeatCount);
+        this->writeVarint(keyEvent._virtualKeyCode);
+        this->writeVarint(keyEvent._virtualScanCode);
+        this->g_buffer.push_back(keyEvent._asciiChar);
+        this->writeVarint(keyEvent._controlKeyState);
+        this->endEvent();
+    }
+    void recordResize(BufferSize size)
+    {
+        this->beginEvent(SessionReplay::EventType::RESIZE);
+        this->writeVarint(size._width);
+        this->writeVarint(size._height);
+        this->endEvent();
+    }
+    void recordFrame(std::string_view frame)
+    {
+        this->beginEvent(SessionReplay::EventType::FRAME);
+        this->writeString(frame);
+        this->endEvent();
+    }
+
+private:
+    void beginEvent(SessionReplay::EventType type)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        auto const delta = std::chrono::duration_cast<std::chrono::microseconds>(now - this->g_last);
+        this->g_last += delta; //Do not accumulate the rounding error
+
+        this->g_buffer.push_back(static_cast<char>(type));
+        this->writeVarint(static_cast<uint64_t>(delta.count()));
+    }
+    void endEvent()
+    {
+        //Flushing periodically keep the recording usable if the program does not exit cleanly
+        if (this->g_buffer.size() >= FlushSize || this->g_last - this->g_lastFlush >= FlushPeriod)
+        {
+            this->flush();
+        }
+    }
+    void flush()
+    {
+        this->g_file.write(this->g_buffer.data(), static_cast<std::streamsize>(this->g_buffer.size()));
+        this->g_file.flush();
+        this->g_buffer.clear();
+        this->g_lastFlush = this->g_last;
+    }
+
+    void writeVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            this->g_buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        this->g_buffer.push_back(static_cast<char>(value));
+    }
+    void writeString(std::string_view str)
+    {
+        this->writeVarint(str.size());
+        this->g_buffer.append(str);
+    }
+
+    std::ofstream g_file;
+    std::string g_buffer;
+    std::chrono::steady_clock::time_point g_last;
+    std::chrono::steady_clock::time_point g_lastFlush;
+    uint64_t g_channelCount{0};
+};
+
+/*
+ * Frames are encoded once and shared between the viewers, every viewer only keeps references
+ * to the frames it still has to send and how much of the first one was already sent.
+ * Sockets are never blocking, a viewer with more than MaxPendingBytes queued drops its queue
+ * (except a partially sent frame) and receives a snapshot in place of the next frame.
+ */
+class AttachServer
+{
+public:
+    static constexpr std::size_t MaxPendingBytes = 1 << 20;
+    static constexpr int MaxIoVectors = 16;
+
+    AttachServer() = default;
+    ~AttachServer()
+    {
+#ifndef _WIN32
+        for (auto const& viewer : this->g_viewers)
+        {
+            ::close(viewer._desc);
+        }
+        if (this->g_desc != -1)
+        {
+            ::close(this->g_desc);
+            (void) unlink(this->g_path.c_str());
+        }
+#endif //_WIN32
+    }
+
+    AttachServer(AttachServer const&) = delete;
+    AttachServer& operator=(AttachServer const&) = delete;
+
+#ifdef _WIN32
+    [[nodiscard]] bool open([[maybe_unused]] std::string const& path)
+    {
+        return false;
+    }
+#else
+    [[nodiscard]] bool open(std::string const& path)
+    {
+        sockaddr_un address{};
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        this->g_desc = CreateSocket();
+        if (this->g_desc == -1)
+        {
+            return false;
+        }
+
+        auto const* socketAddress = reinterpret_cast<sockaddr const*>(&address);
+        if (bind(this->g_desc, socketAddress, sizeof(address)) != 0)
+        {
+            //Only replace a socket file left by a dead server
+            auto const probe = CreateSocket();
+            bool const stale = errno == EADDRINUSE && probe != -1 &&
+                    connect(probe, socketAddress, sizeof(address)) != 0 && errno == ECONNREFUSED;
+            if (probe != -1)
+            {
+                ::close(probe);
+            }
+            if (!stale || unlink(path.c_str()) != 0 || bind(this->g_desc, socketAddress, sizeof(address)) != 0)
+            {
+                ::close(this->g_desc);
+                this->g_desc = -1;
+                return false;
+            }
+        }
+
+        if (listen(this->g_desc, SOMAXCONN) != 0)
+        {
+            ::close(this->g_desc);
+            this->g_desc = -1;
+            (void) unlink(path.c_str());
+            return false;
+        }
+        this->g_path = path;
+        return true;
+    }
+#endif //_WIN32
+
+    [[nodiscard]] std::size_t getViewerCount() const
+    {
+        return this->g_viewers.size();
+    }
+
+    //Accept the new viewers and keep sending the pending frames
+    void poll(Terminal const& terminal)
+    {
+#ifndef _WIN32
+        int desc;
+        while ((desc = accept(this->g_desc, nullptr, nullptr)) != -1)
+        {
+            if (!ConfigureSocket(desc))
+            {
+                ::close(desc);
+                continue;
+            }
+            Viewer viewer;
+            viewer._desc = desc;
+            viewer._resync = true;
+            this->g_viewers.push_back(std::move(viewer));
+        }
+#endif //_WIN32
+
+        this->broadcast(terminal, {});
+    }
+
+    //Queue the frame (or a snapshot for the viewers that are out of sync) and send what can be sent
+    void broadcast(Terminal const& terminal, std::string_view frame)
+    {
+        std::shared_ptr<std::string const> shared;
+        std::shared_ptr<std::string const> snapshot;
+
+        for (auto& viewer : this->g_viewers)
+        {
+            if (viewer._resync)
+            {
+                if (snapshot == nullptr)
+                {
+                    auto data = std::make_shared<std::string>();
+                    terminal.composeSnapshot(*data);
+                    snapshot = std::move(data);
+                }
+                this->push(viewer, snapshot);
+                viewer._resync = false;
+            }
+            else if (!frame.empty())
+            {
+                if (shared == nullptr)
+                {
+                    shared = std::make_shared<std::string const>(frame);
+                }
+                this->push(viewer, shared);
+            }
+
+            this->flush(viewer);
+
+            if (viewer._pendingBytes - viewer._sentBytes > MaxPendingBytes)
+            {
+                auto const keep = viewer._sentBytes != 0 ? 1 : 0;
+                while (viewer._queue.size() > static_cast<std::size_t>(keep))
+                {
+                    viewer._pendingBytes -= viewer._queue.back()->size();
+                    viewer._queue.pop_back();
+                }
+                viewer._resync = true;
+            }
+        }
+
+        this->g_viewers.erase(std::remove_if(this->g_viewers.begin(), this->g_viewers.end(), [](Viewer const& viewer){
+            if (viewer._closed)
+            {
+#ifndef _WIN32
+                ::close(viewer._desc);
+#endif //_WIN32
+                return true;
+            }
+            return false;
+        }), this->g_viewers.end());
+    }
+
+private:
+    struct Viewer
+    {
+        int _desc{-1};
+        std::deque<std::shared_ptr<std::string const> > _queue;
+        std::size_t _pendingBytes{0}; //Size of the queued frames
+        std::size_t _sentBytes{0};    //Already sent bytes of the first frame
+        bool _resync{false};
+        bool _closed{false};
+    };
+
+#ifndef _WIN32
+    [[nodiscard]] static bool ConfigureSocket(int desc)
+    {
+        auto const flags = fcntl(desc, F_GETFL);
+        if (flags == -1 || fcntl(desc, F_SETFL, flags | O_NONBLOCK) != 0 || fcntl(desc, F_SETFD, FD_CLOEXEC) != 0)
+        {
+            return false;
+        }
+    #ifdef SO_NOSIGPIPE
+        int const enabled = 1;
+        (void) setsockopt(desc, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+    #endif //SO_NOSIGPIPE
+        return true;
+    }
+    [[nodiscard]] static int CreateSocket()
+    {
+        auto const desc = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (desc != -1 && !ConfigureSocket(desc))
+        {
+            ::close(desc);
+            return -1;
+        }
+        return desc;
+    }
+#endif //_WIN32
+
+    void push(Viewer& viewer, std::shared_ptr<std::string const> const& data)
+    {
+        if (!data->empty())
+        {
+            viewer._pendingBytes += data->size();
+            viewer._queue.push_back(data);
+        }
+    }
+
+    void flush([[maybe_unused]] Viewer& viewer)
+    {
+#ifndef _WIN32
+    #ifdef MSG_NOSIGNAL
+        constexpr int SendFlags = MSG_NOSIGNAL | MSG_DONTWAIT;
+    #else
+        constexpr int SendFlags = MSG_DONTWAIT;
+    #endif //MSG_NOSIGNAL
+
+        //Viewers never send anything, a read of 0 bytes is a disconnection
+        char discard[256];
+        ssize_t received;
+        while ((received = recv(viewer._desc, discard, sizeof(discard), MSG_DONTWAIT)) > 0);
+        if (received == 0 || (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            viewer._closed = true;
+            return;
+        }
+
+        while (!viewer._queue.empty())
+        {
+            iovec vectors[MaxIoVectors];
+            int count = 0;
+            for (auto it=viewer._queue.begin(); it!=viewer._queue.end() && count<MaxIoVectors; ++it, ++count)
+            {
+                auto const offset = count == 0 ? viewer._sentBytes : 0;
+                vectors[count].iov_base = const_cast<char*>((*it)->data() + offset);
+                vectors[count].iov_len = (*it)->size() - offset;
+            }
+
+            msghdr message{};
+            message.msg_iov = vectors;
+            message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(count);
+
+            auto sent = sendmsg(viewer._desc, &message, SendFlags);
+            if (sent == -1)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    viewer._closed = true;
+                }
+                return;
+            }
+
+            //Release the completely sent frames
+            auto remaining = static_cast<std::size_t>(sent) + viewer._sentBytes;
+            while (!viewer._queue.empty() && remaining >= viewer._queue.front()->size())
+            {
+                remaining -= viewer._queue.front()->size();
+                viewer._pendingBytes -= viewer._queue.front()->size();
+                viewer._queue.pop_front();
+            }
+            viewer._sentBytes = remaining;
+        }
+#endif //_WIN32
+    }
+
+#ifndef _WIN32
+    int g_desc{-1};
+#endif //_WIN32
+    std::string g_path;
+    std::vector<Viewer> g_viewers;
+};
+
+/*
+ * Monotonic arena over a single buffer, released after every frame.
+ * What does not fit in the buffer is allocated from the upstream resource and the buffer
+ * is enlarged for the next frames, so the steady state never reaches the upstream.
+ */
+class FrameArena
+{
+public:
+    static constexpr std::size_t InitialSize = 64 * 1024;
+
+    explicit FrameArena(std::pmr::memory_resource* upstream) :
+            g_overflow(upstream)
+    {
+        this->allocateBuffer(InitialSize);
+    }
+    ~FrameArena()
+    {
+        this->g_arena.reset();
+        this->g_overflow.getUpstream()->deallocate(this->g_buffer, this->g_size, alignof(std::max_align_t));
+    }
+
+    FrameArena(FrameArena const&) = delete;
+    FrameArena& operator=(FrameArena const&) = delete;
+
+    [[nodiscard]] std::pmr::memory_resource* getResource()
+    {
+        return &*this->g_arena;
+    }
+
+    void release()
+    {
+        this->g_arena->release();
+        auto const overflow = this->g_overflow.getAllocatedBytes();
+        if (overflow != 0)
+        {
+            this->g_overflow.reset();
+            this->allocateBuffer((this->g_size + overflow) * 2);
+        }
+    }
+
+private:
+    //Forward to the upstream resource and count the allocated bytes
+    class OverflowResource : public std::pmr::memory_resource
+    {
+    public:
+        explicit OverflowResource(std::pmr::memory_resource* upstream) :
+                g_upstream(upstream)
+        {}
+
+        [[nodiscard]] std::pmr::memory_resource* getUpstream() const { return this->g_upstream; }
+        [[nodiscard]] std::size_t getAllocatedBytes() const { return this->g_allocatedBytes; }
+        void reset() { this->g_allocatedBytes = 0; }
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            this->g_allocatedBytes += bytes;
+            return this->g_upstream->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+        {
+            this->g_upstream->deallocate(p, bytes, alignment);
+        }
+        [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        std::pmr::memory_resource* g_upstream;
+        std::size_t g_allocatedBytes{0};
+    };
+
+    void allocateBuffer(std::size_t size)
+    {
+        this->g_arena.reset();
+        if (this->g_buffer != nullptr)
+        {
+            this->g_overflow.getUpstream()->deallocate(this->g_buffer, this->g_size, alignof(std::max_align_t));
+        }
+        this->g_buffer = this->g_overflow.getUpstream()->allocate(size, alignof(std::max_align_t));
+        this->g_size = size;
+        this->g_arena.emplace(this->g_buffer, this->g_size, &this->g_overflow);
+    }
+
+    OverflowResource g_overflow;
+    void* g_buffer{nullptr};
+    std::size_t g_size{0};
+    std::optional<std::pmr::monotonic_buffer_resource> g_arena;
+};
+
+/*
+ * Decide if a frame can be written without making the device output queue longer than the latency to drain.
+ * When the device reports its queue (TIOCOUTQ) the drain rate is measured between two samples while the
+ * link stays busy. Ptys always report an empty queue, a write() that blocks is the only sign of congestion
+ * there : the queue is full when it returns and the frames are held back while it drains.
+ */
+class OutputPacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //A write shorter than this did not wait for the link
+    static constexpr Clock::duration BlockedWriteThreshold = std::chrono::milliseconds{2};
+    static constexpr double RateSmoothing = 0.25;
+
+    void setMaxLatency(std::chrono::milliseconds latency) { this->g_maxLatency = latency; }
+    [[nodiscard]] std::chrono::milliseconds getMaxLatency() const { return this->g_maxLatency; }
+    [[nodiscard]] double getDrainRate() const { return this->g_drainRate; }
+    [[nodiscard]] std::size_t getHeldFrameCount() const { return this->g_heldFrameCount; }
+
+    //queued is the depth reported by the device, -1 when unknown
+    [[nodiscard]] bool canWriteFrame(int64_t queued, Clock::time_point now)
+    {
+        if (this->g_maxLatency.count() == 0)
+        {
+            return true;
+        }
+        if (now < this->g_holdUntil)
+        {
+            return false;
+        }
+        if (queued < 0)
+        {
+            return true;
+        }
+
+        //The link was busy for the whole interval only if the queue was never seen empty
+        auto const elapsed = std::chrono::duration<double>(now - this->g_lastSample).count();
+        if (this->g_lastQueued > 0 && queued > 0 && elapsed > 0.0)
+        {
+            auto const drained = std::max<int64_t>(this->g_lastQueued + this->g_writtenSinceSample - queued, 0);
+            this->addRateSample(static_cast<double>(drained) / elapsed);
+        }
+        this->g_lastQueued = queued;
+        this->g_lastSample = now;
+        this->g_writtenSinceSample = 0;
+
+        if (queued == 0 || this->g_drainRate <= 0.0)
+        {
+            return true;
+        }
+        return static_cast<double>(queued) / this->g_drainRate <= std::chrono::duration<double>(this->g_maxLatency).count();
+    }
+    void onFrameHeld()
+    {
+        ++this->g_heldFrameCount;
+    }
+    void onFrameWritten(std::size_t size, Clock::time_point begin, Clock::time_point end)
+    {
+        this->g_writtenSinceSample += static_cast<int64_t>(size);
+
+        auto const elapsed = end - begin;
+        if (elapsed >= BlockedWriteThreshold)
+        {
+            //Lower bound, the queue may have accepted a part of the frame at once
+            this->addRateSample(static_cast<double>(size) / std::chrono::duration<double>(elapsed).count());
+            //The queue is full when write() returns, give it at least as long to drain
+            this->g_holdUntil = end + elapsed;
+        }
+    }
+
+private:
+    void addRateSample(double rate)
+    {
+        this->g_drainRate = this->g_drainRate <= 0.0 ? rate : this->g_drainRate + (rate - this->g_drainRate) * RateSmoothing;
+    }
+
+    std::chrono::milliseconds g_maxLatency{100};
+    double g_drainRate{0.0};
+    std::size_t g_heldFrameCount{0};
+
+    int64_t g_lastQueued{0};
+    int64_t g_writtenSinceSample{0};
+    Clock::time_point g_lastSample{};
+    Clock::time_point g_holdUntil{};
+};
+
+/*
+ * Writer of Terminal::exportSnapshot() running on its own thread,
+ * everything it writes was captured under the terminal lock.
+ */
+class SnapshotExport
+{
+public:
+    struct Stream
+    {
+        std::string _name;
+        OutputSnapshot _snapshot;
+        bool _timestamps;
+    };
+
+    SnapshotExport(std::string path, Terminal::SnapshotFormat format) :
+            g_path(std::move(path)),
+            g_format(format)
+    {}
+    ~SnapshotExport()
+    {
+        if (this->g_thread.joinable())
+        {
+            this->g_thread.join();
+        }
+    }
+
+    SnapshotExport(SnapshotExport const&) = delete;
+    SnapshotExport& operator=(SnapshotExport const&) = delete;
+
+    void start(Terminal* terminal, Continuation done, bool* success)
+    {
+        this->g_running = true;
+        this->g_thread = std::thread([this, terminal, done, success](){
+            auto const result = this->write();
+            if (success != nullptr)
+            {
+                *success = result;
+            }
+            if (done._resume != nullptr)
+            {
+                terminal->schedule(done);
+            }
+            //Last, the terminal joins the thread once it is not running anymore
+            this->g_running = false;
+        });
+    }
+    [[nodiscard]] bool isRunning() const
+    {
+        return this->g_running;
+    }
+
+    //Captured screen, a frame for ANSI or the element rows for PLAIN
+    BufferSize _screenSize{0, 0};
+    std::string _screenFrame;
+    std::vector<std::pair<Rect, std::vector<std::string> > > _screenRows;
+    std::vector<Stream> _streams;
+
+private:
+    //Index following the escape sequence starting at i
+    [[nodiscard]] static std::size_t SkipEscapeSequence(std::string_view str, std::size_t i)
+    {
+        if (i+1 < str.size() && str[i+1] == '[')
+        {
+            i += 2;
+            while (i < str.size() && (str[i] < 0x40 || str[i] > 0x7E))
+            {
+                ++i;
+            }
+            return std::min(i+1, str.size());
+        }
+        return std::min(i+2, str.size());
+    }
+
+    [[nodiscard]] bool write() const
+    {
+        std::ofstream file(this->g_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        if (this->g_format == Terminal::SnapshotFormat::PLAIN)
+        {
+            this->writePlainScreen(file);
+            this->writeStreams(file);
+        }
+        else
+        {
+            //The screen is last, the frame repaints it from the top left corner
+            this->writeStreams(file);
+            file << this->_screenFrame << csi::ColorNormal;
+        }
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    void writePlainScreen(std::ostream& file) const
+    {
+        file << "=== Screen " << this->_screenSize._width << 'x' << this->_screenSize._height << " ===\n";
+
+        //Elements are composed in paint order, one cell per visible character (an UTF-8 sequence)
+        std::vector<std::vector<std::string_view> > cells(this->_screenSize._height,
+                                                          std::vector<std::string_view>(this->_screenSize._width, " "));
+        for (auto const& [rect, rows] : this->_screenRows)
+        {
+            for (std::size_t r=0; r<rows.size() && rect._y + r < cells.size(); ++r)
+            {
+                std::string_view const row = rows[r];
+                auto& line = cells[rect._y + r];
+                std::size_t column = rect._x;
+                for (std::size_t i=0; i<row.size(); )
+                {
+                    if (row[i] == '\x1b')
+                    {
+                        i = SkipEscapeSequence(row, i);
+                        continue;
+                    }
+                    auto end = i+1;
+                    while (end < row.size() && (static_cast<uint8_t>(row[end]) & 0xC0) == 0x80)
+                    {
+                        ++end;
+                    }
+                    if (column < line.size())
+                    {
+                        line[column] = row.substr(i, end-i);
+                    }
+                    ++column;
+                    i = end;
+                }
+            }
+        }
+
+        std::string text;
+        for (auto const& line : cells)
+        {
+            text.clear();
+            for (auto const cell : line)
+            {
+                text += cell;
+            }
+            text.erase(text.find_last_not_of(' ') + 1);
+            file << text << '\n';
+        }
+    }
+
+    void writeStreams(std::ostream& file) const
+    {
+        bool const plain = this->g_format == Terminal::SnapshotFormat::PLAIN;
+        std::string text;
+        char timeBuffer[16];
+
+        for (auto const& stream : this->_streams)
+        {
+            file << "=== " << stream._name << ", " << stream._snapshot.getLineCount() << " lines ===\n";
+            (void) stream._snapshot.forEachLine([&](std::string_view line, uint64_t timestamp){
+                text.clear();
+                if (stream._timestamps)
+                {
+                    FormatTimeOfDay(timeBuffer, timestamp);
+                    text += timeBuffer;
+                    text += ' ';
+                }
+                if (plain)
+                {
+                    for (std::size_t i=0; i<line.size(); )
+                    {
+                        if (line[i] == '\x1b')
+                        {
+                            i = SkipEscapeSequence(line, i);
+                            continue;
+                        }
+                        text += line[i++];
+                    }
+                }
+                else
+                {
+                    text += line;
+                }
+                if (text.empty() || text.back() != '\n')
+                {
+                    text += '\n';
+                }
+                file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            });
+        }
+    }
+
+    std::string g_path;
+    Terminal::SnapshotFormat g_format;
+    std::thread g_thread;
+    std::atomic_bool g_running{false};
+};
+
+Region::Region(Terminal* terminal, Region* parent, uint16_t size, uint16_t weight) :
+        g_terminal(terminal),
+        g_parent(parent),
+        g_size(size),
+        g_weight(weight)
+{}
+Region::~Region()
+{
+    this->detachElement();
+}
+
+Region* Region::addRegion(uint16_t size, uint16_t weight)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+
+    auto& ref = this->g_children.emplace_back(new Region(this->g_terminal, this, size, weight));
+    this->g_terminal->invalidateLayout();
+    return ref.get();
+}
+bool Region::removeRegion(Region* region)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+
+    for (auto it=this->g_children.begin(); it!=this->g_children.end(); ++it)
+    {
+        if (it->get() == region)
+        {
+            this->g_children.erase(it);
+            this->g_terminal->invalidateLayout();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Region::setDirection(Direction direction)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+    this->g_direction = direction;
+    this->g_terminal->invalidateLayout();
+}
+Region::Direction Region::getDirection() const
+{
+    return this->g_direction;
+}
+
+void Region::setSize(uint16_t size, uint16_t weight)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+    this->g_size = size;
+    this->g_weight = weight;
+    this->g_terminal->invalidateLayout();
+}
+uint16_t Region::getSize() const
+{
+    return this->g_size;
+}
+uint16_t Region::getWeight() const
+{
+    return this->g_weight;
+}
+
+void Region::setZOrder(int16_t zOrder)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+    this->g_zOrder = zOrder;
+    this->g_terminal->invalidateLayout();
+}
+int16_t Region::getZOrder() const
+{
+    return this->g_zOrder;
+}
+
+void Region::setElement(Element* element)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_terminal->g_mutex);
+
+    if (element == this->g_element)
+    {
+        return;
+    }
+
+    this->detachElement();
+
+    if (element != nullptr)
+    {
+        auto* oldRegion = element->g_region;
+        if (oldRegion != nullptr)
+        {
+            oldRegion->g_element = nullptr;
+            if (oldRegion->g_automatic && oldRegion->g_parent != nullptr)
+            {
+                oldRegion->g_parent->removeRegion(oldRegion);
+            }
+        }
+        element->g_region = this;
+    }
+    this->g_element = element;
+    this->g_automatic = false;
+    this->g_terminal->invalidateLayout();
+}
+Element* Region::getElement() const
+{
+    return this->g_element;
+}
+
+Rect const& Region::getRect() const
+{
+    return this->g_rect;
+}
+Region* Region::getParent() const
+{
+    return this->g_parent;
+}
+
+void Region::computeLayout(Rect rect, int16_t parentZOrder, std::vector<std::pair<int16_t, Element*> >& paintOrder)
+{
+    this->g_rect = rect;
+    auto const zOrder = static_cast<int16_t>(parentZOrder + this->g_zOrder);
+
+    if (this->g_element != nullptr)
+    {
+        auto& elementRect = this->g_element->g_rect;
+        if (elementRect._width != rect._width || elementRect._height != rect._height)
+        {
+            this->g_element->g_renderDirty = true;
+        }
+        elementRect = rect;
+        paintOrder.emplace_back(zOrder, this->g_element);
+    }
+
+    if (this->g_children.empty())
+    {
+        return;
+    }
+
+    bool const rows = this->g_direction == Direction::ROWS;
+    unsigned int const length = rows ? rect._height : rect._width;
+
+    unsigned int fixedLength = 0;
+    unsigned int totalWeight = 0;
+    std::size_t lastFill = 0;
+    for (std::size_t i=0; i<this->g_children.size(); ++i)
+    {
+        auto const& child = this->g_children[i];
+        if (child->g_size != 0)
+        {
+            fixedLength += child->g_size;
+        }
+        else
+        {
+            totalWeight += child->g_weight;
+            lastFill = i;
+        }
+    }
+    unsigned int const remaining = length > fixedLength ? length - fixedLength : 0;
+
+    unsigned int position = 0;
+    unsigned int distributed = 0;
+    for (std::size_t i=0; i<this->g_children.size(); ++i)
+    {
+        auto& child = this->g_children[i];
+
+        unsigned int childLength;
+        if (child->g_size != 0)
+        {
+            childLength = child->g_size;
+        }
+        else if (i == lastFill)
+        {
+            childLength = remaining - distributed;
+        }
+        else
+        {
+            childLength = totalWeight == 0 ? 0 : remaining * child->g_weight / totalWeight;
+            distributed += childLength;
+        }
+        childLength = std::min(childLength, length - position);
+
+        Rect childRect = rect;
+        if (rows)
+        {
+            childRect._y = static_cast<Rect::ValueType>(rect._y + position);
+            childRect._height = static_cast<Rect::ValueType>(childLength);
+        }
+        else
+        {
+            childRect._x = static_cast<Rect::ValueType>(rect._x + position);
+            childRect._width = static_cast<Rect::ValueType>(childLength);
+        }
+        position += childLength;
+
+        child->computeLayout(childRect, zOrder, paintOrder);
+    }
+}
+void Region::detachElement()
+{
+    if (this->g_element != nullptr)
+    {
+        this->g_element->g_region = nullptr;
+        this->g_element->g_rect = {0,0,0,0};
+        this->g_element = nullptr;
+    }
+}
+
+Terminal::Terminal(std::pmr::memory_resource* resource) :
+        g_rootRegion(new Region(this, nullptr, 0, 1)),
+        g_resource(resource),
+        g_frameArena(std::make_unique<FrameArena>(resource)),
+        g_pacer(std::make_unique<OutputPacer>())
+{
+    this->g_defaultOutputStream = this->g_elements.end();
+
+    //Until initialized the terminal writes to the real standard output
+    auto* const original = gOriginalStdoutBuffer.load();
+    this->g_internalOutputStream.rdbuf(original != nullptr ? original : std::cout.rdbuf());
+}
+
+Terminal::~Terminal()
+{
+    //Wait for a running export, it schedules its continuation on the terminal
+    this->g_snapshotExport = nullptr;
+    this->restoreStandardOutputStream();
+}
+
+bool Terminal::init()
+{
+#ifdef _WIN32
+    return this->init(GetStdHandle(STD_INPUT_HANDLE), GetStdHandle(STD_OUTPUT_HANDLE));
+#else
+    return this->init(fileno(stdin), fileno(stdout));
+#endif //_WIN32
+}
+#ifdef _WIN32
+bool Terminal::init(void* inputHandle, void* outputHandle)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_initialized ||
+        inputHandle == nullptr || inputHandle == INVALID_HANDLE_VALUE ||
+        outputHandle == nullptr || outputHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    CONSOLE_SCREEN_BUFFER_INFO bufferInfo;
+    if (GetConsoleScreenBufferInfo(outputHandle, &bufferInfo) != TRUE)
+    {
+        return false;
+    }
+
+    auto rawMode = std::make_unique<RawMode>(outputHandle);
+    if (!rawMode->enable())
+    {
+        return false;
+    }
+    this->g_rawMode = std::move(rawMode);
+
+    this->g_bufferSize._width = bufferInfo.dwSize.X;
+    this->g_bufferSize._height = bufferInfo.dwSize.Y;
+
+    this->g_internalInputHandle._ptr = inputHandle;
+    this->g_internalOutputHandle._ptr = outputHandle;
+#else
+bool Terminal::init(int inputDescriptor, int outputDescriptor)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_initialized || inputDescriptor < 0 || outputDescriptor < 0)
+    {
+        return false;
+    }
+
+    winsize w{};
+    if ( ioctl(outputDescriptor, TIOCGWINSZ, &w) != 0 )
+    {
+        return false;
+    }
+
+    auto rawMode = std::make_unique<RawMode>(inputDescriptor);
+    if (!rawMode->enable())
+    {
+        return false;
+    }
+    this->g_rawMode = std::move(rawMode);
+
+    this->g_bufferSize._width = w.ws_col;
+    this->g_bufferSize._height = w.ws_row;
+
+    this->g_internalInputHandle._desc = inputDescriptor;
+    this->g_internalOutputHandle._desc = outputDescriptor;
+#endif //_WIN32
+
+    //Anything pending on the standard output is written before the first frame
+    this->g_internalOutputStream.flush();
+    std::fflush(stdout);
+#ifdef _WIN32
+    this->g_outputBuffer = std::make_unique<DescriptorStreambuf>(outputHandle);
+#else
+    this->g_outputBuffer = std::make_unique<DescriptorStreambuf>(outputDescriptor);
+#endif //_WIN32
+    this->g_internalOutputStream.rdbuf(this->g_outputBuffer.get());
+
+    this->g_initialized = true;
+    return true;
+}
+bool Terminal::isInitialized() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_initialized;
+}
+
+bool Terminal::redirectStandardOutputStream()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    Terminal* expected = nullptr;
+    if (!gStandardOutputOwner.compare_exchange_strong(expected, this))
+    {
+        return false;
+    }
+
+    this->g_oldStdoutBuffer = std::cout.rdbuf();
+    gOriginalStdoutBuffer.store(this->g_oldStdoutBuffer);
+    this->g_newStdoutBuffer = std::make_unique<StreambufRedirect>(this);
+    std::cout.rdbuf(this->g_newStdoutBuffer.get());
+
+    return true;
+}
+void Terminal::restoreStandardOutputStream()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_newStdoutBuffer == nullptr)
+    {
+        return;
+    }
+
+    std::cout.rdbuf(this->g_oldStdoutBuffer);
+    this->g_newStdoutBuffer = nullptr;
+    this->g_oldStdoutBuffer = nullptr;
+    gStandardOutputOwner.store(nullptr);
+}
+
+BufferSize Terminal::getTerminalBufferSize() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_bufferSize;
+}
+void Terminal::setTerminalBufferSize(BufferSize size)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (size == this->g_bufferSize)
+    {
+        return;
+    }
+
+    if (this->g_recorder != nullptr)
+    {
+        this->g_recorder->recordResize(size);
+    }
+
+    this->g_bufferSize = size;
+    for (auto& element : this->g_elements)
+    {
+        element->onSizeChanged(this->g_bufferSize);
+    }
+    this->invalidateLayout();
+}
+
+bool Terminal::startRecording(std::string const& path)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    auto recorder = std::make_unique<SessionRecorder>();
+    if (!recorder->open(path))
+    {
+        return false;
+    }
+    recorder->recordResize(this->g_bufferSize);
+    this->g_recorder = std::move(recorder);
+    for (auto& channel : this->g_channels)
+    {
+        channel.second._recordId = 0;
+    }
+    this->invalidate(); //Start with a complete frame
+    return true;
+}
+void Terminal::stopRecording()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_recorder = nullptr;
+}
+bool Terminal::isRecording() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_recorder != nullptr;
+}
+bool Terminal::isReplayingInput() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_replayingInput;
+}
+
+bool Terminal::startAttachServer(std::string const& path)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_attachServer != nullptr)
+    {
+        return false;
+    }
+    auto server = std::make_unique<AttachServer>();
+    if (!server->open(path))
+    {
+        return false;
+    }
+    this->g_attachServer = std::move(server);
+    return true;
+}
+void Terminal::stopAttachServer()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_attachServer = nullptr;
+}
+bool Terminal::isAttachServerRunning() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_attachServer != nullptr;
+}
+std::size_t Terminal::getViewerCount() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_attachServer == nullptr ? 0 : this->g_attachServer->getViewerCount();
+}
+
+void Terminal::composeSnapshot(std::string& frame) const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    frame += csi::CursorPosition<1, 1>;
+    frame += csi::EraseDisplay<2>;
+
+    char position[csi::MaxSequenceSize];
+    for (auto const& paint : this->g_paintOrder)
+    {
+        auto const& element = *paint.second;
+        auto const& rect = element.g_rect;
+        if (rect.isEmpty())
+        {
+            continue;
+        }
+        for (std::size_t i=0; i<element.g_renderCache.size(); ++i)
+        {
+            frame.append(position, csi::WriteCursorPosition(position, static_cast<unsigned int>(rect._y + i + 1), rect._x + 1u));
+            frame += element.g_renderCache[i];
+        }
+    }
+
+    //The next frames move the cursor relatively from where the last one left it, the snapshot must end there.
+    //An unknown column is never moved from relatively, an unknown row is left on the input element.
+    auto cursor = this->g_cursor;
+    if (cursor._row == 0)
+    {
+        cursor = this->getCursorPosition();
+    }
+    if (cursor._row != 0)
+    {
+        frame.append(position, csi::WriteCursorPosition(position, cursor._row, cursor._column != 0 ? cursor._column : 1u));
+    }
+}
+
+csi::Cursor Terminal::getCursorPosition() const
+{
+    //The cursor is placed on the input element
+    for (auto const& paint : this->g_paintOrder)
+    {
+        auto const& element = *paint.second;
+        if (element.haveInputStream() && !element.g_rect.isEmpty())
+        {
+            return {element.g_rect._y + element.g_cursorRow + 1u, element.g_rect._x + element.g_cursorColumn + 1u};
+        }
+    }
+    return {};
+}
+
+void Terminal::outputText(std::string_view str)
+{
+    this->outputTextTo(nullptr, str);
+}
+void Terminal::outputTextTo(ChannelRoute* route, std::string_view str)
+{
+    if (str.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    Element* element = route == nullptr ? nullptr : route->_element;
+    if (element == nullptr)
+    {
+        if (this->g_defaultOutputStream == this->g_elements.end())
+        {
+            return;
+        }
+        element = this->g_defaultOutputStream->get();
+    }
+
+    if (this->g_recorder != nullptr)
+    {
+        this->recordOutput(route, str);
+    }
+    element->onInput(str);
+}
+void Terminal::recordOutput(ChannelRoute* route, std::string_view str)
+{
+    //A channel is declared to the recording with its first output, its name is only searched then
+    if (route != nullptr && route->_recordId == 0)
+    {
+        for (auto const& channel : this->g_channels)
+        {
+            if (&channel.second == route)
+            {
+                route->_recordId = this->g_recorder->addChannel(channel.first);
+                break;
+            }
+        }
+    }
+    this->g_recorder->recordOutput(route == nullptr ? 0 : route->_recordId, str);
+}
+
+void Terminal::clearTerminalBuffer()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_internalOutputStream << csi::CursorPosition<1, 1> << csi::EraseDisplay<0> << csi::EraseDisplay<3> << std::flush;
+    this->g_cursor = {};
+    this->invalidate();
+}
+void Terminal::saveCursorPosition()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_internalOutputStream << csi::SaveCursorPosition << std::flush;
+}
+void Terminal::restoreCursorPosition()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_internalOutputStream << csi::RestoreCursorPosition << std::flush;
+    this->g_cursor = {};
+}
+
+Element* Terminal::addElement(std::unique_ptr<Element>&& element)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    auto& ref = this->g_elements.emplace_back(std::move(element));
+
+    ref->setTerminal(this);
+
+    if (ref->haveOutputStream() && this->g_defaultOutputStream == this->g_elements.end())
+    {
+        this->g_defaultOutputStream = this->g_elements.end();
+        --this->g_defaultOutputStream;
+    }
+
+    auto* region = this->g_rootRegion->addRegion(ref->getPreferredHeight());
+    region->setElement(ref.get());
+    region->g_automatic = true;
+
+    return ref.get();
+}
+bool Terminal::removeElement(Element const* element)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    for (auto it=this->g_elements.begin(); it!=this->g_elements.end(); ++it)
+    {
+        if (it->get() != element)
+        {
+            continue;
+        }
+
+        auto* region = element->g_region;
+        if (region != nullptr)
+        {
+            region->detachElement();
+            if (region->g_automatic && region->g_parent != nullptr)
+            {
+                region->g_parent->removeRegion(region);
+            }
+        }
+
+        for (auto& channel : this->g_channels)
+        {
+            if (channel.second._element == element)
+            {
+                channel.second._element = nullptr;
+            }
+        }
+
+        //The paint order is read before the next layout (snapshots, attach resync, cursor position)
+        this->g_paintOrder.erase(std::remove_if(this->g_paintOrder.begin(), this->g_paintOrder.end(),
+                                                [element](auto const& paint){ return paint.second == element; }),
+                                 this->g_paintOrder.end());
+
+        bool const wasDefault = it == this->g_defaultOutputStream;
+        this->g_elements.erase(it);
+
+        if (wasDefault)
+        {
+            this->g_defaultOutputStream = std::find_if(this->g_elements.cbegin(), this->g_elements.cend(),
+                                                       [](auto const& e){ return e->haveOutputStream(); });
+        }
+
+        this->invalidateLayout();
+        return true;
+    }
+    return false;
+}
+
+OutputChannel Terminal::channel(std::string const& name)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return {this, &this->g_channels.try_emplace(name).first->second};
+}
+void Terminal::setChannelOutput(std::string const& name, Element* element)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_channels[name]._element = element;
+}
+Element* Terminal::getChannelOutput(std::string const& name) const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    auto it = this->g_channels.find(name);
+    return it == this->g_channels.end() ? nullptr : it->second._element;
+}
+
+Region* Terminal::getRootRegion()
+{
+    return this->g_rootRegion.get();
+}
+Region* Terminal::addOverlay(Rect rect, int16_t zOrder)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    auto& ref = this->g_overlays.emplace_back(new Region(this, nullptr, 0, 1), rect);
+    ref.first->g_zOrder = zOrder;
+    this->invalidateLayout();
+    return ref.first.get();
+}
+bool Terminal::removeOverlay(Region const* region)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    for (auto it=this->g_overlays.begin(); it!=this->g_overlays.end(); ++it)
+    {
+        if (it->first.get() == region)
+        {
+            this->g_overlays.erase(it);
+            this->invalidateLayout();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Terminal::update()
+{
+    std::vector<Continuation> continuations;
+    {
+        std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+        for (auto& element : this->g_elements)
+        {
+            element->onUpdate();
+        }
+
+        if (this->g_attachServer != nullptr)
+        {
+            this->g_attachServer->poll(*this);
+        }
+
+        if (this->g_initialized)
+        {
+            this->pollInput();
+        }
+
+        if (this->g_scheduled.empty())
+        {
+            return;
+        }
+        //The two buffers are exchanged to keep their capacity
+        continuations.swap(this->g_scheduled);
+        this->g_scheduled.swap(this->g_spareScheduled);
+    }
+
+    //Resumed without the lock, a continuation can wait again or run on for a long time
+    for (auto const& continuation : continuations)
+    {
+        continuation._resume(continuation._context);
+    }
+
+    continuations.clear();
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_spareScheduled.swap(continuations);
+}
+void Terminal::pollInput()
+{
+#ifdef _WIN32
+    INPUT_RECORD records[10];
+    DWORD read = 0;
+
+    if (WaitForSingleObject(this->g_internalInputHandle._ptr, 0) != WAIT_OBJECT_0)
+    {
+        return;
+    }
+
+    auto errOut = ReadConsoleInput(this->g_internalInputHandle._ptr,
+                                   records, sizeof(records)/sizeof(INPUT_RECORD), &read);
+
+    if (errOut == 0)
+    {
+        return;
+    }
+
+    for (DWORD i=0; i<read; ++i)
+    {
+        if (records[i].EventType == KEY_EVENT)
+        {
+            KeyEvent keyEvent{records[i].Event.KeyEvent.bKeyDown==TRUE,
+                              records[i].Event.KeyEvent.wRepeatCount,
+                              records[i].Event.KeyEvent.wVirtualKeyCode,
+                              records[i].Event.KeyEvent.wVirtualScanCode,
+                              records[i].Event.KeyEvent.uChar.AsciiChar,
+                              records[i].Event.KeyEvent.dwControlKeyState};
+
+            this->pushKeyEvent(keyEvent);
+        }
+        else if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
+        {
+            this->setTerminalBufferSize({static_cast<BufferSize::ValueType>(records[i].Event.WindowBufferSizeEvent.dwSize.X),
+                                         static_cast<BufferSize::ValueType>(records[i].Event.WindowBufferSizeEvent.dwSize.Y)});
+        }
+    }
+#else
+    winsize w{};
+    if ( ioctl(this->g_internalOutputHandle._desc, TIOCGWINSZ, &w) == 0 )
+    {///TODO not great, I prefer events
+        this->setTerminalBufferSize({static_cast<BufferSize::ValueType>(w.ws_col),
+                                     static_cast<BufferSize::ValueType>(w.ws_row)});
+    }
+
+    uint8_t buffer[10];
+    auto result = read(this->g_internalInputHandle._desc, &buffer, 10);
+    if (result == -1 || result == 0)
+    {
+        return;
+    }
+
+    for (decltype(result) i=0; i<result; ++i)
+    {
+        auto c = static_cast<char>(buffer[i]);
+
+        KeyEvent keyEvent{true, 1,
+                          0, 0,
+                          c, 0};
+
+        this->pushKeyEvent(keyEvent);
+    }
+#endif //_WIN32
+}
+void Terminal::pushKeyEvent(KeyEvent const& keyEvent)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_recorder != nullptr)
+    {
+        this->g_recorder->recordKey(keyEvent);
+    }
+
+    if (keyEvent._keyDown && !this->g_keyWaiters.empty())
+    {
+        auto const waiter = this->g_keyWaiters.front();
+        this->g_keyWaiters.pop_front();
+        *waiter.second = keyEvent;
+        this->schedule(waiter.first);
+        return;
+    }
+
+    for (auto& element : this->g_elements)
+    {
+        if (element->haveInputStream())
+        {
+            element->onKeyInput(keyEvent);
+        }
+    }
+}
+void Terminal::replayKeyEvent(KeyEvent const& keyEvent)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    //Neither recorded again nor given to the key waiters, what they produced is in the recording
+    this->g_replayingInput = true;
+    for (auto& element : this->g_elements)
+    {
+        if (element->haveInputStream())
+        {
+            element->onKeyInput(keyEvent);
+        }
+    }
+    this->g_replayingInput = false;
+}
+void Terminal::render() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    this->g_scheduled.insert(this->g_scheduled.end(), this->g_frameWaiters.begin(), this->g_frameWaiters.end());
+    this->g_frameWaiters.clear();
+
+    if (!this->g_invalidRender)
+    {
+        return;
+    }
+
+    //A layout change repaint everything from the render caches, only resized elements are rendered again
+    bool const fullRepaint = this->g_invalidLayout;
+
+    //A congested device only receives the input rows, the other elements stay dirty until it drains
+    bool inputOnly = false;
+    if (!this->g_pacer->canWriteFrame(this->getOutputQueueSize(), OutputPacer::Clock::now()))
+    {
+        inputOnly = !fullRepaint &&
+                std::any_of(this->g_paintOrder.begin(), this->g_paintOrder.end(), [](auto const& paint){
+                    return paint.second->haveInputStream() && paint.second->g_renderDirty;
+                });
+        if (!inputOnly)
+        {
+            this->g_pacer->onFrameHeld();
+            return;
+        }
+    }
+    else
+    {
+        this->g_invalidRender = false;
+    }
+
+    this->g_frame.clear();
+
+    if (fullRepaint)
+    {
+        this->computeLayout();
+        this->g_frame += csi::CursorPosition<1, 1>;
+        this->g_frame += csi::EraseDisplay<2>;
+        this->g_cursor = {1, 1};
+    }
+
+    char move[csi::MaxSequenceSize];
+    {
+        //Temporary render data lives in the frame arena, it must be destroyed before the arena is released
+        auto* const frameResource = this->g_frameArena->getResource();
+        std::pmr::string content(frameResource);
+        std::pmr::vector<std::pmr::string> rows(frameResource);
+        std::pmr::vector<Rect> repainted(frameResource);
+        if (!inputOnly)
+        {
+            repainted.assign(this->g_deferredRepaint.begin(), this->g_deferredRepaint.end());
+            this->g_deferredRepaint.clear();
+        }
+        StringStreambuf contentBuffer(content);
+        this->g_renderStream.rdbuf(&contentBuffer);
+
+        for (auto const& paint : this->g_paintOrder)
+        {
+            auto const& element = *paint.second;
+            auto const& rect = element.g_rect;
+            if (rect.isEmpty() || (inputOnly && !element.haveInputStream()))
+            {
+                continue;
+            }
+
+            //Elements composed over a repainted area must be repainted as well
+            bool repaint = fullRepaint ||
+                    std::any_of(repainted.begin(), repainted.end(), [&](Rect const& r){ return r.intersects(rect); });
+
+            bool const rendered = element.g_renderDirty;
+            if (rendered)
+            {
+                this->renderElement(element, content, rows);
+            }
+            else if (!repaint)
+            {
+                continue;
+            }
+
+            //Only the rows that differ from the cache are emitted
+            auto& cache = element.g_renderCache;
+            auto const rowCount = rendered ? rows.size() : cache.size();
+            bool painted = false;
+            for (std::size_t i=0; i<rowCount; ++i)
+            {
+                std::string_view const row = rendered ? std::string_view{rows[i]} : std::string_view{cache[i]};
+                if (!repaint && i < cache.size() && cache[i] == row)
+                {
+                    continue;
+                }
+                csi::Cursor const position{static_cast<unsigned int>(rect._y + i + 1), rect._x + 1u};
+                this->g_frame.append(move, csi::WriteCursorMove(move, this->g_cursor, position));
+                this->g_frame += row;
+                painted = true;
+
+                //The row is left as is but the width of the text is an estimation, the column is not trusted
+                this->g_cursor = {position._row, 0};
+            }
+
+            //The cache rows keep their capacity
+            if (rendered)
+            {
+                cache.resize(rows.size());
+                for (std::size_t i=0; i<rows.size(); ++i)
+                {
+                    cache[i].assign(rows[i].data(), rows[i].size());
+                }
+            }
+            if (painted)
+            {
+                repainted.push_back(rect);
+                if (inputOnly)
+                {
+                    this->g_deferredRepaint.push_back(rect);
+                }
+            }
+        }
+
+        this->g_renderStream.rdbuf(nullptr);
+    }
+
+    auto const position = this->getCursorPosition();
+    if (position._row != 0)
+    {
+        this->g_frame.append(move, csi::WriteCursorMove(move, this->g_cursor, position));
+        this->g_cursor = position;
+    }
+
+    if (this->g_recorder != nullptr)
+    {
+        this->g_recorder->recordFrame(this->g_frame);
+    }
+    if (this->g_attachServer != nullptr)
+    {
+        this->g_attachServer->broadcast(*this, this->g_frame);
+    }
+
+    auto const writeBegin = OutputPacer::Clock::now();
+    this->g_internalOutputStream.write(this->g_frame.data(), static_cast<std::streamsize>(this->g_frame.size()));
+    this->g_internalOutputStream << std::flush;
+    this->g_pacer->onFrameWritten(this->g_frame.size(), writeBegin, OutputPacer::Clock::now());
+
+    this->g_frameArena->release();
+}
+bool Terminal::exportSnapshot(std::string const& path, SnapshotFormat format, Continuation done, bool* success)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (this->g_snapshotExport != nullptr && this->g_snapshotExport->isRunning())
+    {
+        return false;
+    }
+
+    auto snapshotExport = std::make_unique<SnapshotExport>(path, format);
+
+    //The screen is copied from the render caches, the lines are only referenced
+    if (format == SnapshotFormat::ANSI)
+    {
+        this->composeSnapshot(snapshotExport->_screenFrame);
+    }
+    else
+    {
+        snapshotExport->_screenSize = this->g_bufferSize;
+        for (auto const& paint : this->g_paintOrder)
+        {
+            auto const& element = *paint.second;
+            if (!element.g_rect.isEmpty())
+            {
+                snapshotExport->_screenRows.emplace_back(element.g_rect, element.g_renderCache);
+            }
+        }
+    }
+
+    std::size_t number = 0;
+    for (auto it=this->g_elements.begin(); it!=this->g_elements.end(); ++it)
+    {
+        auto const* stream = dynamic_cast<TextOutputStream const*>(it->get());
+        if (stream == nullptr)
+        {
+            continue;
+        }
+
+        std::string name = "Output " + std::to_string(++number);
+        if (it == this->g_defaultOutputStream)
+        {
+            name += " (default)";
+        }
+        for (auto const& channel : this->g_channels)
+        {
+            if (channel.second._element == stream)
+            {
+                name += " (" + channel.first + ')';
+            }
+        }
+        snapshotExport->_streams.push_back({std::move(name), stream->takeSnapshot(),
+                                            stream->getTimestampMode() != TextOutputStream::TimestampMode::NONE});
+    }
+
+    //A finished export is joined here, it does not need the lock anymore
+    this->g_snapshotExport = std::move(snapshotExport);
+    this->g_snapshotExport->start(this, done, success);
+    return true;
+}
+bool Terminal::isExportingSnapshot() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_snapshotExport != nullptr && this->g_snapshotExport->isRunning();
+}
+
+void Terminal::setMaxOutputLatency(std::chrono::milliseconds latency)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_pacer->setMaxLatency(latency);
+}
+std::chrono::milliseconds Terminal::getMaxOutputLatency() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_pacer->getMaxLatency();
+}
+double Terminal::getOutputDrainRate() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_pacer->getDrainRate();
+}
+std::size_t Terminal::getHeldFrameCount() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_pacer->getHeldFrameCount();
+}
+int64_t Terminal::getOutputQueueSize() const
+{
+#ifdef _WIN32
+    return -1;
+#else
+    int queued = 0;
+    if (!this->g_initialized || ioctl(this->g_internalOutputHandle._desc, TIOCOUTQ, &queued) != 0)
+    {
+        return -1;
+    }
+    return queued;
+#endif //_WIN32
+}
+
+std::pmr::memory_resource* Terminal::getMemoryResource() const
+{
+    return this->g_resource;
+}
+std::pmr::memory_resource* Terminal::getFrameResource() const
+{
+    return this->g_frameArena->getResource();
+}
+
+void Terminal::schedule(Continuation continuation) const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_scheduled.push_back(continuation);
+}
+void Terminal::awaitKey(Continuation continuation, KeyEvent* keyEvent)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_keyWaiters.emplace_back(continuation, keyEvent);
+}
+void Terminal::awaitFrame(Continuation continuation)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_frameWaiters.push_back(continuation);
+}
+
+void Terminal::invalidate() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    for (auto const& element : this->g_elements)
+    {
+        element->g_renderDirty = true;
+    }
+    this->g_invalidLayout = true;
+    this->g_invalidRender = true;
+}
+void Terminal::invalidateElement(Element const* element) const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    element->g_renderDirty = true;
+    this->g_invalidRender = true;
+}
+void Terminal::invalidateLayout() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_invalidLayout = true;
+    this->g_invalidRender = true;
+}
+
+void Terminal::computeLayout() const
+{
+    this->g_invalidLayout = false;
+    this->g_paintOrder.clear();
+
+    Rect const screen{0, 0, this->g_bufferSize._width, this->g_bufferSize._height};
+    this->g_rootRegion->computeLayout(screen, 0, this->g_paintOrder);
+
+    for (auto const& overlay : this->g_overlays)
+    {
+        auto rect = overlay.second;
+        rect._x = std::min(rect._x, screen._width);
+        rect._y = std::min(rect._y, screen._height);
+        rect._width = std::min<Rect::ValueType>(rect._width, screen._width - rect._x);
+        rect._height = std::min<Rect::ValueType>(rect._height, screen._height - rect._y);
+        overlay.first->computeLayout(rect, 0, this->g_paintOrder);
+    }
+
+    std::stable_sort(this->g_paintOrder.begin(), this->g_paintOrder.end(),
+                     [](auto const& a, auto const& b){ return a.first < b.first; });
+}
+void Terminal::renderElement(Element const& element, std::pmr::string& content, std::pmr::vector<std::pmr::string>& rows) const
+{
+    element.g_renderDirty = false;
+
+    content.clear();
+    this->g_renderStream.clear();
+    element.render(this->g_renderStream);
+
+    auto const& rect = element.g_rect;
+    Rect::ValueType cursorColumn = 0;
+    Rect::ValueType cursorRow = 0;
+    LayoutRows(content, rect._width, rows, cursorColumn, cursorRow);
+
+    //Clip the rows to the rectangle
+    if (rows.size() > rect._height)
+    {
+        if (element.isScrolling())
+        {
+            auto const removed = rows.size() - rect._height;
+            rows.erase(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(removed));
+            cursorRow = cursorRow > removed ? static_cast<Rect::ValueType>(cursorRow - removed) : 0;
+        }
+        else
+        {
+            rows.resize(rect._height);
+        }
+    }
+    rows.resize(rect._height, std::pmr::string(rect._width, ' ', rows.get_allocator().resource()));
+
+    element.g_cursorColumn = cursorColumn;
+    element.g_cursorRow = std::min<Rect::ValueType>(cursorRow, rect._height - 1);
+}
+
+EventLoop::EventLoop() = default;
+EventLoop::~EventLoop() = default;
+
+bool EventLoop::addTerminal(Terminal* terminal)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    if (terminal == nullptr || !terminal->isInitialized())
+    {
+        return false;
+    }
+    for (auto const& entry : this->g_terminals)
+    {
+        if (entry._terminal == terminal)
+        {
+            return false;
+        }
+    }
+
+    this->g_terminals.push_back({terminal, false});
+#ifndef _WIN32
+    this->g_descriptors.reserve(this->g_terminals.size());
+#endif //_WIN32
+    return true;
+}
+bool EventLoop::removeTerminal(Terminal const* terminal)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    for (auto it=this->g_terminals.begin(); it!=this->g_terminals.end(); ++it)
+    {
+        if (it->_terminal == terminal)
+        {
+            this->g_terminals.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+std::size_t EventLoop::getTerminalCount() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_terminals.size();
+}
+
+void EventLoop::setFrameInterval(std::chrono::milliseconds interval)
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    this->g_frameInterval = std::max(interval, std::chrono::milliseconds{1});
+}
+std::chrono::milliseconds EventLoop::getFrameInterval() const
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    return this->g_frameInterval;
+}
+
+void EventLoop::runOnce()
+{
+    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+
+    //A late loop does not try to catch up the missed frames
+    auto const now = std::chrono::steady_clock::now();
+    if (this->g_nextFrame + this->g_frameInterval < now)
+    {
+        this->g_nextFrame = now;
+    }
+    auto const timeout = std::chrono::ceil<std::chrono::milliseconds>(std::max(this->g_nextFrame - now,
+                                                                               std::chrono::steady_clock::duration::zero()));
+
+    //Wait for input on every device
+#ifdef _WIN32
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    DWORD count = 0;
+    for (auto const& entry : this->g_terminals)
+    {
+        if (!entry._hangup && count < MAXIMUM_WAIT_OBJECTS)
+        {
+            handles[count++] = entry._terminal->g_internalInputHandle._ptr;
+        }
+    }
+
+    if (count == 0)
+    {
+        std::this_thread::sleep_for(timeout);
+    }
+    else if (WaitForMultipleObjects(count, handles, FALSE, static_cast<DWORD>(timeout.count())) == WAIT_FAILED)
+    {
+        //A closed handle fail every wait, stop waiting on all of them
+        for (auto& entry : this->g_terminals)
+        {
+            entry._hangup = true;
+        }
+    }
+#else
+    auto& descriptors = this->g_descriptors;
+    descriptors.clear();
+    for (auto const& entry : this->g_terminals)
+    {
+        if (!entry._hangup)
+        {
+            descriptors.push_back({entry._terminal->g_internalInputHandle._desc, POLLIN, 0});
+        }
+    }
+
+    if (descriptors.empty())
+    {
+        std::this_thread::sleep_for(timeout);
+    }
+    else if (::poll(descriptors.data(), static_cast<nfds_t>(descriptors.size()), static_cast<int>(timeout.count())) > 0)
+    {
+        //A closed device is always ready, waiting on it would spin
+        std::size_t index = 0;
+        for (auto& entry : this->g_terminals)
+        {
+            if (!entry._hangup)
+            {
+                entry._hangup = (descriptors[index++].revents & (POLLHUP | POLLERR | POLLNVAL)) != 0;
+            }
+        }
+    }
+#endif //_WIN32
+
+    //Callbacks run by update() can add or remove terminals
+    for (std::size_t i=0; i<this->g_terminals.size(); ++i)
+    {
+        this->g_terminals[i]._terminal->update();
+    }
+
+    if (std::chrono::steady_clock::now() >= this->g_nextFrame)
+    {
+        this->g_nextFrame += this->g_frameInterval;
+        for (std::size_t i=0; i<this->g_terminals.size(); ++i)
+        {
+            this->g_terminals[i]._terminal->render();
+        }
+    }
+}
+void EventLoop::run()
+{
+    this->g_running = true;
+    while (this->g_running)
+    {
+        this->runOnce();
+    }
+}
+void EventLoop::stop()
+{
+    this->g_running = false;
+}
+bool EventLoop::isRunning() const
+{
+    return this->g_running;
+}
+
+TextOutputStream::TextOutputStream(std::pmr::memory_resource* resource) :
+        g_linePool(resource),
+        g_chunks(&this->g_linePool),
+        g_search(std::make_unique<ScrollbackSearch>(&this->g_linePool))
+{}
+TextOutputStream::~TextOutputStream() = default;
+
+void TextOutputStream::render(std::ostream& stream) const
+{
+    auto const now = this->g_timestampMode == TimestampMode::RELATIVE_NOW ? GetCoarseTimestamp() : 0;
+
+    if (this->g_search->isActive())
+    {
+        auto const& matches = this->g_search->getMatches();
+        auto const rows = this->getVisibleRowCount();
+        auto const end = matches.size() - std::min(this->g_scrollOffset, matches.size());
+        auto const begin = end > rows ? end - rows : 0;
+
+        for (std::size_t i=begin; i<end; ++i)
+        {
+            this->renderLine(stream, matches[i] - this->g_search->getLineBegin(), now);
+        }
+        return;
+    }
+
+    //Only the visible window is rendered, cold lines are paged in on demand
+    auto const rows = this->getVisibleRowCount();
+    auto const count = this->getLineCount();
+    auto const end = count - std::min(this->g_scrollOffset, count);
+    auto const begin = end > rows ? end - rows : 0;
+
+    for (std::size_t i=begin; i<end; ++i)
+    {
+        this->renderLine(stream, i, now);
+    }
+}
+
+void TextOutputStream::setBufferLimit(std::size_t limit)
+{
+    this->g_bufferLimit = limit;
+}
+std::size_t TextOutputStream::getBufferLimit() const
+{
+    return this->g_bufferLimit;
+}
+
+bool TextOutputStream::enableScrollbackFile(std::string const& directory)
+{
+    if (this->g_scrollback != nullptr)
+    {
+        return false;
+    }
+    this->g_scrollback = std::make_unique<ScrollbackFile>(directory);
+    return true;
+}
+void TextOutputStream::disableScrollbackFile()
+{
+    //The cold lines are discarded, the search indices must follow
+    if (this->g_scrollback != nullptr)
+    {
+        this->g_search->onLinesDropped(this->g_scrollback->getLineCount());
+    }
+    this->g_scrollback = nullptr;
+    this->g_scrollOffset = 0;
+    this->invalidate();
+}
+bool TextOutputStream::isScrollbackFileEnabled() const
+{
+    return this->g_scrollback != nullptr;
+}
+
+std::size_t TextOutputStream::getLineCount() const
+{
+    auto const coldCount = this->g_scrollback == nullptr ? 0 : this->g_scrollback->getLineCount();
+    return coldCount + this->g_lineCount;
+}
+std::string_view TextOutputStream::getLine(std::size_t index) const
+{
+    auto const coldCount = this->g_scrollback == nullptr ? 0 : this->g_scrollback->getLineCount();
+    if (index < coldCount)
+    {
+        return this->g_scrollback->getLine(index);
+    }
+    index -= coldCount;
+    return index < this->g_lineCount ? this->findChunk(this->g_firstLine + index).getLine(this->g_firstLine + index) : std::string_view{};
+}
+
+void TextOutputStream::setScrollOffset(std::size_t offset)
+{
+    this->g_scrollOffset = std::min(offset, this->getLineCount());
+    this->invalidate();
+}
+std::size_t TextOutputStream::getScrollOffset() const
+{
+    return this->g_scrollOffset;
+}
+
+OutputSnapshot TextOutputStream::takeSnapshot() const
+{
+    OutputSnapshot snapshot;
+    if (!this->g_chunks.empty())
+    {
+        snapshot.g_firstChunk = this->g_chunks.front();
+        snapshot.g_lastChunk = this->g_chunks.back().get();
+    }
+    snapshot.g_firstLine = this->g_firstLine;
+    snapshot.g_hotLineCount = this->g_lineCount;
+
+    if (this->g_scrollback != nullptr)
+    {
+        auto const& segments = this->g_scrollback->getSegments();
+        snapshot.g_segments.assign(segments.begin(), segments.end());
+        snapshot.g_coldLineCount = this->g_scrollback->getLineCount();
+    }
+    return snapshot;
+}
+void TextOutputStream::setTimestampMode(TimestampMode mode)
+{
+    this->g_timestampMode = mode;
+    this->invalidate();
+}
+TextOutputStream::TimestampMode TextOutputStream::getTimestampMode() const
+{
+    return this->g_timestampMode;
+}
+uint64_t TextOutputStream::getLineTimestamp(std::size_t index) const
+{
+    auto const coldCount = this->g_scrollback == nullptr ? 0 : this->g_scrollback->getLineCount();
+    if (index < coldCount)
+    {
+        return this->g_scrollback->getTimestamp(index);
+    }
+    index -= coldCount;
+    return index < this->g_lineCount ? this->findChunk(this->g_firstLine + index).getTimestamp(this->g_firstLine + index) : 0;
+}
+
+void TextOutputStream::setFilter(std::string_view pattern, FilterMode mode)
+{
+    if (pattern.empty())
+    {
+        this->clearFilter();
+        return;
+    }
+    this->g_search->setPattern(pattern, mode);
+    this->g_scrollOffset = 0;
+    this->invalidate();
+}
+void TextOutputStream::clearFilter()
+{
+    this->g_search->clearPattern();
+    this->g_scrollOffset = 0;
+    this->invalidate();
+}
+bool TextOutputStream::isFiltered() const
+{
+    return this->g_search->isActive();
+}
+std::string const& TextOutputStream::getFilter() const
+{
+    return this->g_search->getPattern();
+}
+std::size_t TextOutputStream::getMatchCount() const
+{
+    return this->g_search->getMatches().size();
+}
+bool TextOutputStream::isFilterComplete() const
+{
+    return this->g_search->isComplete();
+}
+
+void TextOutputStream::clear()
+{
+    this->g_chunks.clear();
+    this->g_firstLine = 0;
+    this->g_lineCount = 0;
+    if (this->g_scrollback != nullptr)
+    {
+        this->g_scrollback->clear();
+    }
+    this->g_search->reset();
+    this->g_scrollOffset = 0;
+    this->invalidate();
+}
+
+void TextOutputStream::onInput(std::string_view str)
+{
+    this->appendLine(str, GetCoarseTimestamp());
+    this->g_search->onLineAdded(str);
+
+    auto limit = this->g_bufferLimit;
+    if (this->g_scrollback != nullptr && limit == 0)
+    {
+        limit = DefaultHotLineCount;
+    }
+
+    bool grown = true;
+    if (limit != 0 && this->g_lineCount > limit)
+    {
+        bool spilled = false;
+        if (this->g_scrollback != nullptr)
+        {
+            auto const& chunk = *this->g_chunks.front();
+            spilled = this->g_scrollback->push(chunk.getLine(this->g_firstLine), chunk.getTimestamp(this->g_firstLine));
+            if (!spilled)
+            {
+                //Keeping the line hot would grow the stream without bound while the device is failing
+                this->disableScrollbackFile();
+                this->g_bufferLimit = limit;
+                this->_onScrollbackFailure.call();
+            }
+        }
+
+        if (spilled)
+        {
+            this->dropFirstLine();
+        }
+        else
+        {
+            this->g_search->onLinesDropped(1);
+            this->dropFirstLine();
+            grown = false;
+        }
+    }
+
+    //Keep the view anchored when scrolled back
+    if (this->g_scrollOffset != 0 && !this->g_search->isActive())
+    {
+        if (grown)
+        {
+            ++this->g_scrollOffset;
+        }
+        this->g_scrollOffset = std::min(this->g_scrollOffset, this->getLineCount());
+    }
+    if (!this->g_search->isActive())
+    {
+        this->invalidate();
+    }
+}
+void TextOutputStream::onUpdate()
+{
+    //Ages are displayed with a second resolution
+    if (this->g_timestampMode == TimestampMode::RELATIVE_NOW)
+    {
+        auto const second = GetCoarseTimestamp() / 1000;
+        if (second != this->g_timestampSecond)
+        {
+            this->g_timestampSecond = second;
+            this->invalidate();
+        }
+    }
+
+    if (!this->g_search->isActive() || this->g_search->isComplete())
+    {
+        return;
+    }
+
+    auto const budget = this->g_search->getMode() == FilterMode::REGEX ? FilterRegexScanBudget : FilterScanBudget;
+    if (this->g_search->advance(*this, budget))
+    {
+        this->invalidate();
+    }
+}
+
+void TextOutputStream::appendLine(std::string_view line, uint64_t timestamp)
+{
+    if (!this->g_chunks.empty() && this->g_chunks.back()->append(line, timestamp))
+    {
+        ++this->g_lineCount;
+        return;
+    }
+
+    auto const first = this->g_firstLine + this->g_lineCount;
+    std::shared_ptr<LineChunk> chunk;
+    if (this->g_spareChunk != nullptr && line.size() <= LineChunk::DataCapacity)
+    {
+        chunk = std::move(this->g_spareChunk);
+        chunk->reset(first);
+    }
+    else
+    {
+        auto* const upstream = this->g_linePool.upstream_resource();
+        chunk = std::allocate_shared<LineChunk>(std::pmr::polymorphic_allocator<LineChunk>(upstream),
+                                                first, std::max(LineChunk::DataCapacity, line.size()), upstream);
+    }
+    (void) chunk->append(line, timestamp);
+
+    if (!this->g_chunks.empty())
+    {
+        this->g_chunks.back()->_next = chunk;
+    }
+    this->g_chunks.push_back(std::move(chunk));
+    ++this->g_lineCount;
+}
+void TextOutputStream::dropFirstLine()
+{
+    ++this->g_firstLine;
+    --this->g_lineCount;
+
+    auto& front = this->g_chunks.front();
+    if (this->g_chunks.size() > 1 && this->g_firstLine == front->getFirstLine() + front->getLineCount())
+    {
+        //Referenced by a snapshot (directly or through the previous chunk) otherwise
+        if (front.use_count() == 1 && front->isStandardSize())
+        {
+            this->g_spareChunk = std::move(front);
+        }
+        this->g_chunks.pop_front();
+    }
+}
+LineChunk const& TextOutputStream::findChunk(std::size_t line) const
+{
+    //Most lookups are for the last rendered lines
+    if (line >= this->g_chunks.back()->getFirstLine())
+    {
+        return *this->g_chunks.back();
+    }
+    auto const it = std::upper_bound(this->g_chunks.begin(), this->g_chunks.end(), line,
+                                     [](std::size_t value, auto const& chunk){
+        return value < chunk->getFirstLine();
+    });
+    return **std::prev(it);
+}
+std::size_t TextOutputStream::getVisibleRowCount() const
+{
+    return std::max<std::size_t>(this->getRect()._height, 1);
+}
+void TextOutputStream::renderLine(std::ostream& stream, std::size_t index, uint64_t now) const
+{
+    if (this->g_timestampMode == TimestampMode::NONE)
+    {
+        stream << this->getLine(index);
+        return;
+    }
+
+    char buffer[16];
+    auto const timestamp = this->getLineTimestamp(index);
+    switch (this->g_timestampMode)
+    {
+    case TimestampMode::ABSOLUTE:
+        FormatTimeOfDay(buffer, timestamp);
+        break;
+    case TimestampMode::RELATIVE_PREVIOUS:
+    {
+        auto const delta = index == 0 ? 0 : timestamp - std::min(timestamp, this->getLineTimestamp(index - 1));
+        std::snprintf(buffer, sizeof(buffer), "+%5llu.%03u", static_cast<unsigned long long>(std::min<uint64_t>(delta / 1000, 99999)),
+                      static_cast<unsigned int>(delta % 1000));
+        break;
+    }
+    default:
+    {
+        auto const age = (now - std::min(now, timestamp)) / 1000;
+        if (age < 60)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%7us ago", static_cast<unsigned int>(age));
+        }
+        else if (age < 3600)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%4um%02us ago", static_cast<unsigned int>(age / 60),
+                          static_cast<unsigned int>(age % 60));
+        }
+        else if (age < 86400)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%4uh%02um ago", static_cast<unsigned int>(age / 3600),
+                          static_cast<unsigned int>(age / 60 % 60));
+        }
+        else
+        {
+            std::snprintf(buffer, sizeof(buffer), "%4ud%02uh ago", static_cast<unsigned int>(std::min<uint64_t>(age / 86400, 9999)),
+                          static_cast<unsigned int>(age / 3600 % 24));
+        }
+        break;
+    }
+    }
+
+    stream << csi::ColorFgCyan << buffer << csi::ColorNormal << ' ' << this->getLine(index);
+}
+
+std::size_t OutputSnapshot::getLineCount() const
+{
+    return this->g_coldLineCount + this->g_hotLineCount;
+}
+bool OutputSnapshot::forEachLine(std::function<void(std::string_view line, uint64_t timestamp)> const& function) const
+{
+    //Cold lines, the segment files are mapped again (the last one is still being written)
+    MappedFile map;
+    std::size_t line = 0;
+    for (std::size_t i=0; i<this->g_segments.size() && line<this->g_coldLineCount; ++i)
+    {
+        auto const& segment = *this->g_segments[i];
+        if (!map.open(segment._path, ScrollbackFile::SegmentHeaderSize + segment._dataCapacity, false))
+        {
+            return false;
+        }
+
+        auto const end = i+1 < this->g_segments.size() ?
+                std::min(this->g_segments[i+1]->_firstLine, this->g_coldLineCount) : this->g_coldLineCount;
+        auto const* timestamps = reinterpret_cast<uint64_t const*>(map.data());
+        auto const* offsets = reinterpret_cast<uint32_t const*>(map.data() + ScrollbackFile::SegmentOffsetsPosition);
+        auto const* data = map.data() + ScrollbackFile::SegmentHeaderSize;
+        for (; line<end; ++line)
+        {
+            auto const index = line - segment._firstLine;
+            function({data + offsets[index], offsets[index + 1] - offsets[index]}, timestamps[index]);
+        }
+    }
+
+    //Hot lines, the line count of the last chunk is the captured one
+    auto const* chunk = this->g_firstChunk.get();
+    auto const end = this->g_firstLine + this->g_hotLineCount;
+    for (auto id=this->g_firstLine; id<end && chunk!=nullptr; )
+    {
+        auto const chunkEnd = chunk == this->g_lastChunk ? end : chunk->getFirstLine() + chunk->getLineCount();
+        for (; id<chunkEnd; ++id)
+        {
+            function(chunk->getLine(id), chunk->getTimestamp(id));
+        }
+        chunk = chunk == this->g_lastChunk ? nullptr : chunk->_next.get();
+    }
+    return true;
+}
+
+ProcessOutput::ProcessOutput(std::pmr::memory_resource* resource) :
+        TextOutputStream(resource)
+{}
+ProcessOutput::~ProcessOutput()
+{
+    Close(this->g_stdout);
+    Close(this->g_stderr);
+    if (this->g_running)
+    {
+        this->terminate();
+#ifdef _WIN32
+        WaitForSingleObject(this->g_process, INFINITE);
+        CloseHandle(this->g_process);
+#else
+        //A child ignoring SIGTERM is killed once the timeout is reached
+        int status = 0;
+        auto const deadline = std::chrono::steady_clock::now() + TerminateTimeout;
+        for (pid_t result; (result = waitpid(this->g_pid, &status, WNOHANG)) == 0 || (result == -1 && errno == EINTR); )
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                kill(this->g_pid, SIGKILL);
+                while (waitpid(this->g_pid, &status, 0) == -1 && errno == EINTR)
+                {}
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+#endif //_WIN32
+    }
+}
+
+bool ProcessOutput::start(std::vector<std::string> const& arguments)
+{
+    if (this->g_running || arguments.empty())
+    {
+        return false;
+    }
+    Close(this->g_stdout);
+    Close(this->g_stderr);
+
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES attributes{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+    HANDLE outRead, outWrite, errRead, errWrite;
+    if (CreatePipe(&outRead, &outWrite, &attributes, 0) == 0)
+    {
+        return false;
+    }
+    if (CreatePipe(&errRead, &errWrite, &attributes, 0) == 0)
+    {
+        CloseHandle(outRead);
+        CloseHandle(outWrite);
+        return false;
+    }
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(errRead, HANDLE_FLAG_INHERIT, 0);
+
+    std::string commandLine;
+    for (auto const& argument : arguments)
+    {
+        if (!commandLine.empty())
+        {
+            commandLine += ' ';
+        }
+        if (argument.find_first_of(" \t\"") == std::string::npos)
+        {
+            commandLine += argument;
+        }
+        else
+        {
+            commandLine += '"';
+            commandLine += argument;
+            commandLine += '"';
+        }
+    }
+
+    STARTUPINFOA startupInfo{};
+    startupInfo.cb = sizeof(startupInfo);
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdInput = nullptr;
+    startupInfo.hStdOutput = outWrite;
+    startupInfo.hStdError = errWrite;
+
+    PROCESS_INFORMATION processInfo{};
+    auto const created = CreateProcessA(nullptr, commandLine.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW,
+                                        nullptr, nullptr, &startupInfo, &processInfo);
+    CloseHandle(outWrite);
+    CloseHandle(errWrite);
+    if (created == 0)
+    {
+        CloseHandle(outRead);
+        CloseHandle(errRead);
+        return false;
+    }
+    CloseHandle(processInfo.hThread);
+
+    this->g_process = processInfo.hProcess;
+    this->g_stdout._handle = outRead;
+    this->g_stderr._handle = errRead;
+#else
+    //Close-on-exec from their creation, a process spawned by another thread must not inherit them
+    auto const openPipe = [](int (&fds)[2]){
+#ifdef __APPLE__
+        //No pipe2(), they are marked right after
+        if (pipe(fds) != 0)
+        {
+            return false;
+        }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return true;
+#else
+        return pipe2(fds, O_CLOEXEC) == 0;
+#endif //__APPLE__
+    };
+
+    int outPipe[2];
+    int errPipe[2];
+    if (!openPipe(outPipe))
+    {
+        return false;
+    }
+    if (!openPipe(errPipe))
+    {
+        ::close(outPipe[0]);
+        ::close(outPipe[1]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+    for (int fd : {outPipe[0], outPipe[1], errPipe[0], errPipe[1]})
+    {
+        posix_spawn_file_actions_addclose(&actions, fd);
+    }
+
+    std::vector<char*> argv;
+    argv.reserve(arguments.size() + 1);
+    for (auto const& argument : arguments)
+    {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    auto const result = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    ::close(outPipe[1]);
+    ::close(errPipe[1]);
+    if (result != 0)
+    {
+        ::close(outPipe[0]);
+        ::close(errPipe[0]);
+        return false;
+    }
+
+    for (int fd : {outPipe[0], errPipe[0]})
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    this->g_pid = pid;
+    this->g_stdout._fd = outPipe[0];
+    this->g_stderr._fd = errPipe[0];
+#endif //_WIN32
+
+    this->g_stdout._buffer.resize(MaxLineLength);
+    this->g_stderr._buffer.resize(MaxLineLength);
+    this->g_running = true;
+    this->g_exitCode = 0;
+    return true;
+}
+void ProcessOutput::terminate()
+{
+    if (!this->g_running)
+    {
+        return;
+    }
+#ifdef _WIN32
+    TerminateProcess(this->g_process, 1);
+#else
+    kill(this->g_pid, SIGTERM);
+#endif //_WIN32
+}
+
+bool ProcessOutput::isRunning() const
+{
+    return this->g_running;
+}
+int ProcessOutput::getExitCode() const
+{
+    return this->g_exitCode;
+}
+
+void ProcessOutput::onUpdate()
+{
+    std::size_t budget = ReadBudget;
+    budget -= this->readPipe(this->g_stdout, budget, false);
+    (void) this->readPipe(this->g_stderr, budget, true);
+
+    if (this->g_running && !IsOpen(this->g_stdout) && !IsOpen(this->g_stderr))
+    {
+        this->checkExit();
+    }
+
+    TextOutputStream::onUpdate();
+}
+
+bool ProcessOutput::IsOpen(Pipe const& pipe)
+{
+#ifdef _WIN32
+    return pipe._handle != nullptr;
+#else
+    return pipe._fd != -1;
+#endif //_WIN32
+}
+void ProcessOutput::Close(Pipe& pipe)
+{
+#ifdef _WIN32
+    if (pipe._handle != nullptr)
+    {
+        CloseHandle(pipe._handle);
+        pipe._handle = nullptr;
+    }
+#else
+    if (pipe._fd != -1)
+    {
+        ::close(pipe._fd);
+        pipe._fd = -1;
+    }
+#endif //_WIN32
+    pipe._used = 0;
+}
+
+std::size_t ProcessOutput::readPipe(Pipe& pipe, std::size_t budget, bool error)
+{
+    std::size_t total = 0;
+
+    while (IsOpen(pipe) && total < budget)
+    {
+        if (pipe._used == pipe._buffer.size())
+        {//Line too long, split it
+            this->pushLine({pipe._buffer.data(), pipe._used}, error);
+            pipe._used = 0;
+        }
+
+        auto const space = std::min(pipe._buffer.size() - pipe._used, budget - total);
+        char* data = pipe._buffer.data() + pipe._used;
+
+#ifdef _WIN32
+        DWORD available = 0;
+        long long result = 0;
+        if (PeekNamedPipe(pipe._handle, nullptr, 0, nullptr, &available, nullptr) == 0)
+        {
+            result = -1; //Broken pipe, the process closed its end
+        }
+        else if (available == 0)
+        {
+            break;
+        }
+        else
+        {
+            DWORD readSize = 0;
+            result = ReadFile(pipe._handle, data, static_cast<DWORD>(std::min<std::size_t>(space, available)),
+                              &readSize, nullptr) == 0 ? -1 : static_cast<long long>(readSize);
+        }
+#else
+        auto const result = read(pipe._fd, data, space);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+        }
+#endif //_WIN32
+
+        if (result <= 0)
+        {//End of file (or error), flush the unterminated line
+            if (pipe._used != 0)
+            {
+                this->pushLine({pipe._buffer.data(), pipe._used}, error);
+            }
+            Close(pipe);
+            break;
+        }
+
+        total += static_cast<std::size_t>(result);
+
+        //Lines are given to the output stream directly from the read buffer
+        char const* begin = pipe._buffer.data();
+        char const* const end = data + result;
+        char const* search = data;
+        while (auto const* newLine = static_cast<char const*>(std::memchr(search, '\n', static_cast<std::size_t>(end - search))))
+        {
+            this->pushLine({begin, static_cast<std::size_t>(newLine - begin + 1)}, error);
+            begin = newLine + 1;
+            search = begin;
+        }
+
+        pipe._used = static_cast<std::size_t>(end - begin);
+        if (begin != pipe._buffer.data() && pipe._used != 0)
+        {
+            std::memmove(pipe._buffer.data(), begin, pipe._used);
+        }
+    }
+
+    return total;
+}
+void ProcessOutput::pushLine(std::string_view line, bool error)
+{
+    if (!error)
+    {
+        this->onInput(line);
+        return;
+    }
+
+    this->g_errorLine.assign(csi::ColorFgRed);
+    this->g_errorLine.append(line);
+    if (!line.empty() && line.back() == '\n')
+    {
+        this->g_errorLine.pop_back();
+    }
+    this->g_errorLine += csi::ColorNormal;
+    this->g_errorLine += '\n';
+    this->onInput(this->g_errorLine);
+}
+void ProcessOutput::checkExit()
+{
+#ifdef _WIN32
+    if (WaitForSingleObject(this->g_process, 0) != WAIT_OBJECT_0)
+    {
+        return;
+    }
+    DWORD exitCode = 0;
+    GetExitCodeProcess(this->g_process, &exitCode);
+    CloseHandle(this->g_process);
+    this->g_process = nullptr;
+    this->g_exitCode = static_cast<int>(exitCode);
+#else
+    int status = 0;
+    if (waitpid(this->g_pid, &status, WNOHANG) != this->g_pid)
+    {
+        return;
+    }
+    this->g_pid = -1;
+    this->g_exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif //_WIN32
+
+    this->g_running = false;
+    this->_onExit.call(int{this->g_exitCode});
+}
+
+CompletionTrie::CompletionTrie() :
+        g_nodes(1)
+{}
+
+bool CompletionTrie::insert(std::string_view word, uint32_t value)
+{
+    if (word.empty() || value == InvalidValue || this->getValue(word) != InvalidValue)
+    {
+        return false;
+    }
+
+    NodeIndex node = Root;
+    ++this->g_nodes[Root]._count;
+    for (auto const c : word)
+    {
+        //Find the child or the sibling after which it must be inserted
+        NodeIndex previous = InvalidNode;
+        NodeIndex child = this->g_nodes[node]._firstChild;
+        while (child != InvalidNode && static_cast<uint8_t>(this->g_nodes[child]._char) < static_cast<uint8_t>(c))
+        {
+            previous = child;
+            child = this->g_nodes[child]._nextSibling;
+        }
+
+        if (child == InvalidNode || this->g_nodes[child]._char != c)
+        {
+            NodeIndex created;
+            if (this->g_freeNodes.empty())
+            {
+                created = static_cast<NodeIndex>(this->g_nodes.size());
+                this->g_nodes.emplace_back();
+            }
+            else
+            {
+                created = this->g_freeNodes.back();
+                this->g_freeNodes.pop_back();
+                this->g_nodes[created] = Node{};
+            }
+            this->g_nodes[created]._char = c;
+            this->g_nodes[created]._nextSibling = child;
+            (previous == InvalidNode ? this->g_nodes[node]._firstChild : this->g_nodes[previous]._nextSibling) = created;
+            child = created;
+        }
+
+        node = child;
+        ++this->g_nodes[node]._count;
+    }
+    this->g_nodes[node]._value = value;
+    return true;
+}
+bool CompletionTrie::erase(std::string_view word)
+{
+    if (this->getValue(word) == InvalidValue)
+    {
+        return false;
+    }
+
+    NodeIndex node = Root;
+    --this->g_nodes[Root]._count;
+    for (auto const c : word)
+    {
+        NodeIndex previous = InvalidNode;
+        NodeIndex child = this->g_nodes[node]._firstChild;
+        while (this->g_nodes[child]._char != c)
+        {
+            previous = child;
+            child = this->g_nodes[child]._nextSibling;
+        }
+
+        //A node without any word below it is released with the rest of the path
+        if (--this->g_nodes[child]._count == 0)
+        {
+            (previous == InvalidNode ? this->g_nodes[node]._firstChild : this->g_nodes[previous]._nextSibling) =
+                    this->g_nodes[child]._nextSibling;
+            for (auto released = child; released != InvalidNode; released = this->g_nodes[released]._firstChild)
+            {
+                this->g_freeNodes.push_back(released);
+            }
+            return true;
+        }
+        node = child;
+    }
+    this->g_nodes[node]._value = InvalidValue;
+    return true;
+}
+void CompletionTrie::clear()
+{
+    this->g_nodes.assign(1, Node{});
+    this->g_freeNodes.clear();
+}
+
+std::size_t CompletionTrie::getWordCount() const
+{
+    return this->g_nodes[Root]._count;
+}
+uint32_t CompletionTrie::getValue(std::string_view word) const
+{
+    auto const node = this->find(word);
+    return node == InvalidNode ? InvalidValue : this->g_nodes[node]._value;
+}
+
+CompletionTrie::NodeIndex CompletionTrie::step(NodeIndex node, char c) const
+{
+    if (node == InvalidNode)
+    {
+        return InvalidNode;
+    }
+    for (auto child = this->g_nodes[node]._firstChild; child != InvalidNode; child = this->g_nodes[child]._nextSibling)
+    {
+        auto const childChar = static_cast<uint8_t>(this->g_nodes[child]._char);
+        if (childChar >= static_cast<uint8_t>(c))
+        {
+            return childChar == static_cast<uint8_t>(c) ? child : InvalidNode;
+        }
+    }
+    return InvalidNode;
+}
+CompletionTrie::NodeIndex CompletionTrie::find(std::string_view prefix, NodeIndex node) const
+{
+    for (std::size_t i=0; i<prefix.size() && node != InvalidNode; ++i)
+    {
+        node = this->step(node, prefix[i]);
+    }
+    return node;
+}
+
+std::size_t CompletionTrie::getCandidateCount(NodeIndex node) const
+{
+    return node == InvalidNode ? 0 : this->g_nodes[node]._count;
+}
+void CompletionTrie::appendCompletion(NodeIndex node, std::string& str) const
+{
+    if (node == InvalidNode || this->g_nodes[node]._count == 0)
+    {
+        return;
+    }
+
+    auto const size = str.size();
+    while (this->g_nodes[node]._value == InvalidValue)
+    {
+        auto const child = this->g_nodes[node]._firstChild;
+        if (this->g_nodes[child]._nextSibling != InvalidNode)
+        {
+            //The candidates diverge, nothing in common : suggest the first one
+            if (str.size() == size)
+            {
+                for (; this->g_nodes[node]._value == InvalidValue; node = this->g_nodes[node]._firstChild)
+                {
+                    str.push_back(this->g_nodes[this->g_nodes[node]._firstChild]._char);
+                }
+            }
+            return;
+        }
+        node = child;
+        str.push_back(this->g_nodes[node]._char);
+    }
+}
+
+bool CommandRegistry::addCommand(std::string_view name, Handler handler)
+{
+    uint32_t slot;
+    if (this->g_freeHandlers.empty())
+    {
+        slot = static_cast<uint32_t>(this->g_handlers.size());
+    }
+    else
+    {
+        slot = this->g_freeHandlers.back();
+    }
+
+    if (!this->g_commands.insert(name, slot))
+    {
+        return false;
+    }
+
+    if (slot == this->g_handlers.size())
+    {
+        this->g_handlers.push_back(std::move(handler));
+    }
+    else
+    {
+        this->g_freeHandlers.pop_back();
+        this->g_handlers[slot] = std::move(handler);
+    }
+    return true;
+}
+bool CommandRegistry::removeCommand(std::string_view name)
+{
+    auto const slot = this->g_commands.getValue(name);
+    if (!this->g_commands.erase(name))
+    {
+        return false;
+    }
+    this->g_handlers[slot] = nullptr;
+    this->g_freeHandlers.push_back(slot);
+    return true;
+}
+bool CommandRegistry::haveCommand(std::string_view name) const
+{
+    return this->g_commands.getValue(name) != CompletionTrie::InvalidValue;
+}
+
+bool CommandRegistry::addCompletion(std::string_view word)
+{
+    return this->g_completions.insert(word);
+}
+bool CommandRegistry::removeCompletion(std::string_view word)
+{
+    return this->g_completions.erase(word);
+}
+
+bool CommandRegistry::execute(std::string_view line)
+{
+    //The buffer is taken during the call, a handler can execute another command
+    auto arguments = std::move(this->g_arguments);
+    Tokenize(line, arguments);
+
+    auto const slot = arguments.empty() ? CompletionTrie::InvalidValue : this->g_commands.getValue(arguments.front());
+    if (slot != CompletionTrie::InvalidValue)
+    {
+        //A copy, the handler can remove its own command
+        auto const handler = this->g_handlers[slot];
+        handler(arguments);
+    }
+
+    this->g_arguments = std::move(arguments);
+    return slot != CompletionTrie::InvalidValue;
+}
+
+CompletionTrie const& CommandRegistry::getCommands() const
+{
+    return this->g_commands;
+}
+CompletionTrie const& CommandRegistry::getCompletions() const
+{
+    return this->g_completions;
+}
+
+void CommandRegistry::Tokenize(std::string_view line, Arguments& arguments)
+{
+    arguments.clear();
+
+    std::size_t i = 0;
+    while (true)
+    {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t'))
+        {
+            ++i;
+        }
+        if (i == line.size())
+        {
+            return;
+        }
+
+        if (line[i] == '"')
+        {
+            auto const end = std::min(line.find('"', i+1), line.size());
+            arguments.push_back(line.substr(i+1, end-i-1));
+            i = std::min(end+1, line.size());
+        }
+        else
+        {
+            auto const end = std::min(line.find_first_of(" \t", i), line.size());
+            arguments.push_back(line.substr(i, end-i));
+            i = end;
+        }
+    }
+}
+
+void TextInputStream::render(std::ostream& stream) const
+{
+    if (this->g_filtering)
+    {
+        stream << csi::ColorFgYellow << "FILTER> " << csi::ColorNormal << this->g_filterBuffer;
+        if (this->g_filterTarget != nullptr)
+        {
+            stream << csi::ColorFgYellow << " [" << this->g_filterTarget->getMatchCount()
+                   << (this->g_filterTarget->isFilterComplete() ? "]" : "...]") << csi::ColorNormal;
+        }
+        return;
+    }
+    stream << csi::ColorFgGreen << "INPUT> " << csi::ColorNormal << this->g_inputBuffer;
+
+    //Inline suggestion after the cursor
+    if (this->g_completionPath.size() > 1)
+    {
+        auto const* trie = this->getCompletionTrie();
+        auto const node = this->g_completionPath.back();
+        auto const count = trie->getCandidateCount(node);
+
+        stream << csi::SaveCursorPosition;
+        if (count != 0)
+        {
+            this->g_suggestion.clear();
+            trie->appendCompletion(node, this->g_suggestion);
+            stream << csi::Sgr<2> << this->g_suggestion;
+            if (count > 1)
+            {
+                stream << " [" << count << ']';
+            }
+            stream << csi::ColorNormal;
+        }
+    }
+}
+
+void TextInputStream::setFilterTarget(TextOutputStream* target)
+{
+    this->g_filterTarget = target;
+    this->g_filtering = false;
+}
+TextOutputStream* TextInputStream::getFilterTarget() const
+{
+    return this->g_filterTarget;
+}
+
+void TextInputStream::setCommandRegistry(CommandRegistry* registry)
+{
+    this->g_registry = registry;
+    this->resetCompletion();
+    this->invalidate();
+}
+CommandRegistry* TextInputStream::getCommandRegistry() const
+{
+    return this->g_registry;
+}
+
+void TextInputStream::resetCompletion()
+{
+    this->g_completionPath.clear();
+    if (this->g_registry == nullptr)
+    {
+        return;
+    }
+
+    auto const tokenBegin = this->g_inputBuffer.find_last_of(' ') + 1;
+    this->g_completingCommand = this->g_inputBuffer.find_first_not_of(' ') >= tokenBegin;
+
+    auto const* trie = this->getCompletionTrie();
+    this->g_completionPath.push_back(CompletionTrie::Root);
+    for (auto i=tokenBegin; i<this->g_inputBuffer.size(); ++i)
+    {
+        this->g_completionPath.push_back(trie->step(this->g_completionPath.back(), this->g_inputBuffer[i]));
+    }
+}
+void TextInputStream::pushCompletion(char c)
+{
+    if (this->g_registry == nullptr)
+    {
+        return;
+    }
+    if (c == ' ' || this->g_completionPath.empty())
+    {
+        this->resetCompletion();
+        return;
+    }
+    this->g_completionPath.push_back(this->getCompletionTrie()->step(this->g_completionPath.back(), c));
+}
+void TextInputStream::awaitLine(Continuation continuation, std::string* line)
+{
+    std::lock_guard<std::mutex> const lock(this->g_lineWaitersMutex);
+    this->g_lineWaiters.emplace_back(continuation, line);
+}
+
+CompletionTrie const* TextInputStream::getCompletionTrie() const
+{
+    return this->g_completingCommand ? &this->g_registry->getCommands() : &this->g_registry->getCompletions();
+}
+
+void TextInputStream::applyFilter()
+{
+    if (this->g_filterBuffer.size() > 1 && this->g_filterBuffer.front() == '/')
+    {
+        this->g_filterTarget->setFilter(std::string_view{this->g_filterBuffer}.substr(1),
+                                        TextOutputStream::FilterMode::REGEX);
+    }
+    else
+    {
+        this->g_filterTarget->setFilter(this->g_filterBuffer);
+    }
+}
+
+void TextInputStream::onKeyInput(KeyEvent const& keyEvent)
+{
+    if (keyEvent._keyDown && this->g_filterTarget != nullptr)
+    {
+        //Ctrl+F
+        if (keyEvent._asciiChar == 0x06)
+        {
+            if (this->g_filtering)
+            {
+                this->g_filterBuffer.clear();
+                this->g_filterTarget->clearFilter();
+            }
+            this->g_filtering = !this->g_filtering;
+            this->invalidate();
+            return;
+        }
+
+        if (this->g_filtering)
+        {
+#ifdef _WIN32
+            if (keyEvent._asciiChar == '\r')
+#else
+            if (keyEvent._asciiChar == '\n')
+#endif //_WIN32
+            {
+                this->g_filtering = false;
+            }
+#ifdef _WIN32
+            else if (keyEvent._asciiChar == '\b')
+#else
+            else if (keyEvent._asciiChar == 127)
+#endif //_WIN32
+            {
+                if (this->g_filterBuffer.empty())
+                {
+                    return;
+                }
+                this->g_filterBuffer.pop_back();
+                this->applyFilter();
+            }
+            else if (iscntrl(keyEvent._asciiChar) == 0)
+            {
+                this->g_filterBuffer.push_back(keyEvent._asciiChar);
+                this->applyFilter();
+            }
+            this->invalidate();
+            return;
+        }
+    }
+
+    if (keyEvent._keyDown)
+    {
+        //Enter
+#ifdef _WIN32
+        if (keyEvent._asciiChar == '\r')
+#else
+        if (keyEvent._asciiChar == '\n')
+#endif //_WIN32
+        {
+            if (this->g_inputBuffer.empty())
+            {
+                return;
+            }
+
+            //A replayed line is neither echoed nor dispatched, the recording has the output of both
+            if (this->getTerminal()->isReplayingInput())
+            {
+                this->g_inputBuffer.clear();
+                this->resetCompletion();
+                this->invalidate();
+                return;
+            }
+
+            this->getTerminal()->output("%s\n", this->g_inputBuffer.c_str());
+
+            std::unique_lock<std::mutex> waitersLock(this->g_lineWaitersMutex);
+            if (!this->g_lineWaiters.empty())
+            {
+                auto const waiter = this->g_lineWaiters.front();
+                this->g_lineWaiters.pop_front();
+                waitersLock.unlock();
+
+                *waiter.second = this->g_inputBuffer;
+                this->getTerminal()->schedule(waiter.first);
+            }
+            else
+            {
+                waitersLock.unlock();
+
+                if (this->g_registry != nullptr)
+                {
+                    (void) this->g_registry->execute(this->g_inputBuffer);
+                }
+                this->_onInput.call(this->g_inputBuffer);
+            }
+            this->g_inputBuffer.clear();
+            this->resetCompletion();
+            this->invalidate();
+            return;
+        }
+        //Backspace
+#ifdef _WIN32
+        else if (keyEvent._asciiChar == '\b')
+#else
+        else if (keyEvent._asciiChar == 127)
+#endif //_WIN32
+        {
+            if (!this->g_inputBuffer.empty())
+            {
+                auto const removed = this->g_inputBuffer.back();
+                this->g_inputBuffer.pop_back();
+                if (removed == ' ' || this->g_completionPath.size() < 2)
+                {
+                    this->resetCompletion();
+                }
+                else
+                {
+                    this->g_completionPath.pop_back();
+                }
+                this->invalidate();
+            }
+            return;
+        }
+        //Tab, accept the suggestion and end the word if it is the only candidate
+        else if (keyEvent._asciiChar == '\t')
+        {
+            if (this->g_completionPath.size() < 2)
+            {
+                return;
+            }
+
+            auto const* trie = this->getCompletionTrie();
+            auto const size = this->g_inputBuffer.size();
+            trie->appendCompletion(this->g_completionPath.back(), this->g_inputBuffer);
+            for (auto i=size; i<this->g_inputBuffer.size(); ++i)
+            {
+                this->g_completionPath.push_back(trie->step(this->g_completionPath.back(), this->g_inputBuffer[i]));
+            }
+            if (trie->getCandidateCount(this->g_completionPath.back()) == 1)
+            {
+                this->g_inputBuffer.push_back(' ');
+                this->resetCompletion();
+            }
+            this->invalidate();
+            return;
+        }
+        //Unhandled control
+        else if (iscntrl(keyEvent._asciiChar) != 0)
+        {
+            return;
+        }
+
+        this->g_inputBuffer.push_back(keyEvent._asciiChar);
+        this->pushCompletion(keyEvent._asciiChar);
+        this->invalidate();
+    }
+}
+
+Banner::Banner(std::string_view banner) :
+        g_banner{banner}
+{}
+
+void Banner::render(std::ostream& stream) const
+{
+    auto const width = static_cast<std::size_t>(this->getRect()._width);
+    auto const length = this->g_banner.size() + 2;
+    if (this->g_centered && length < width)
+    {
+        std::fill_n(std::ostreambuf_iterator<char>(stream), (width - length)/2, ' ');
+    }
+    stream << csi::Sgr<47, 30>;
+    stream << ' ' << this->g_banner << ' ' << csi::ColorNormal;
+}
+
+void Banner::setBanner(std::string_view banner)
+{
+    this->g_banner = banner;
+    this->invalidate();
+}
+std::string const& Banner::getBanner() const
+{
+    return this->g_banner;
+}
+
+void Banner::setCenterFlag(bool centered)
+{
+    this->g_centered = centered;
+    this->invalidate();
+}
+bool Banner::isCentered() const
+{
+    return this->g_centered;
+}
+
+ProgressBar::ProgressBar(uint64_t total, std::string_view label) :
+        _total(total),
+        g_label(label)
+{}
+
+void ProgressBar::render(std::ostream& stream) const
+{
+    if (!this->g_label.empty())
+    {
+        stream << this->g_label << ' ';
+    }
+
+    double const ratio = this->g_total == 0 ? 0.0 :
+            static_cast<double>(this->g_value) / static_cast<double>(this->g_total);
+
+    auto const width = this->getBarWidth();
+    if (width != 0)
+    {
+        stream << '[';
+        RenderBar(stream, width, ComputeBarEighths(ratio, width));
+        stream << ']';
+    }
+
+    char text[16];
+    FormatPercent(text, ratio);
+    stream << text;
+}
+
+void ProgressBar::setLabel(std::string_view label)
+{
+    this->g_label = label;
+    this->invalidate();
+}
+std::string const& ProgressBar::getLabel() const
+{
+    return this->g_label;
+}
+
+void ProgressBar::onUpdate()
+{
+    auto const value = this->_value.load(std::memory_order_relaxed);
+    auto const total = this->_total.load(std::memory_order_relaxed);
+    if (value == this->g_value && total == this->g_total)
+    {
+        return;
+    }
+
+    auto const ratio = [](uint64_t v, uint64_t t){
+        return t == 0 ? 0.0 : std::clamp(static_cast<double>(v) / static_cast<double>(t), 0.0, 1.0);
+    };
+    auto const newRatio = ratio(value, total);
+    auto const oldRatio = ratio(this->g_value, this->g_total);
+
+    char newText[16];
+    char oldText[16];
+    FormatPercent(newText, newRatio);
+    FormatPercent(oldText, oldRatio);
+
+    auto const width = this->getBarWidth();
+    bool const changed = ComputeBarEighths(newRatio, width) != ComputeBarEighths(oldRatio, width) ||
+            std::strcmp(newText, oldText) != 0;
+
+    this->g_value = value;
+    this->g_total = total;
+    if (changed)
+    {
+        this->invalidate();
+    }
+}
+
+std::size_t ProgressBar::getBarWidth() const
+{
+    std::size_t const labelWidth = this->g_label.empty() ? 0 : GetTextWidth(this->g_label) + 1;
+    std::size_t const reserved = labelWidth + 2 + 7; //Brackets and " 100.0%"
+    return this->getRect()._width > reserved ? this->getRect()._width - reserved : 0;
+}
+
+Gauge::Gauge(double min, double max, std::string_view label) :
+        g_label(label),
+        g_min(min),
+        g_max(max)
+{}
+
+void Gauge::render(std::ostream& stream) const
+{
+    if (!this->g_label.empty())
+    {
+        stream << this->g_label << ' ';
+    }
+
+    auto const width = this->getBarWidth();
+    if (width != 0)
+    {
+        double const range = this->g_max - this->g_min;
+        double const ratio = range == 0.0 ? 0.0 : (this->g_value - this->g_min) / range;
+
+        stream << '[';
+        RenderBar(stream, width, ComputeBarEighths(ratio, width));
+        stream << ']';
+    }
+
+    stream << ' ' << this->g_text;
+}
+
+void Gauge::setLabel(std::string_view label)
+{
+    this->g_label = label;
+    this->invalidate();
+}
+std::string const& Gauge::getLabel() const
+{
+    return this->g_label;
+}
+
+void Gauge::setRange(double min, double max)
+{
+    this->g_min = min;
+    this->g_max = max;
+    this->invalidate();
+}
+double Gauge::getMin() const
+{
+    return this->g_min;
+}
+double Gauge::getMax() const
+{
+    return this->g_max;
+}
+
+void Gauge::setPrecision(int precision)
+{
+    this->g_precision = precision;
+    this->g_text.clear();
+    this->invalidate();
+}
+int Gauge::getPrecision() const
+{
+    return this->g_precision;
+}
+
+void Gauge::onUpdate()
+{
+    auto const value = this->_value.load(std::memory_order_relaxed);
+    if (value == this->g_value && !this->g_text.empty())
+    {
+        return;
+    }
+
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.*f", this->g_precision, value);
+
+    double const range = this->g_max - this->g_min;
+    auto const ratio = [&](double v){
+        return range == 0.0 ? 0.0 : (v - this->g_min) / range;
+    };
+    auto const oldEighths = ComputeBarEighths(ratio(this->g_value), this->getBarWidth());
+
+    bool const textChanged = this->g_text != text;
+    this->g_value = value;
+    if (textChanged)
+    {
+        this->g_text = text;
+    }
+
+    if (textChanged || ComputeBarEighths(ratio(value), this->getBarWidth()) != oldEighths)
+    {
+        this->invalidate();
+    }
+}
+
+std::size_t Gauge::getBarWidth() const
+{
+    std::size_t const labelWidth = this->g_label.empty() ? 0 : GetTextWidth(this->g_label) + 1;
+    std::size_t const reserved = labelWidth + 2 + 1 + this->g_text.size(); //Brackets and value
+    return this->getRect()._width > reserved ? this->getRect()._width - reserved : 0;
+}
+
+Sparkline::Sparkline(std::string_view label) :
+        g_label(label)
+{}
+
+void Sparkline::render(std::ostream& stream) const
+{
+    if (!this->g_label.empty())
+    {
+        stream << this->g_label << ' ';
+    }
+    for (auto level : this->g_levels)
+    {
+        stream << gLevelBlocks[static_cast<std::size_t>(level)];
+    }
+}
+
+void Sparkline::setLabel(std::string_view label)
+{
+    this->g_label = label;
+    this->invalidate();
+}
+std::string const& Sparkline::getLabel() const
+{
+    return this->g_label;
+}
+
+void Sparkline::setRange(double min, double max)
+{
+    this->g_min = min;
+    this->g_max = max;
+    this->computeLevels(this->g_levels);
+    this->invalidate();
+}
+double Sparkline::getMin() const
+{
+    return this->g_min;
+}
+double Sparkline::getMax() const
+{
+    return this->g_max;
+}
+
+void Sparkline::setSamplePeriod(std::chrono::milliseconds period)
+{
+    this->g_samplePeriod = period;
+}
+std::chrono::milliseconds Sparkline::getSamplePeriod() const
+{
+    return this->g_samplePeriod;
+}
+
+void Sparkline::onUpdate()
+{
+    auto const now = std::chrono::steady_clock::now();
+    if (now - this->g_lastSample < this->g_samplePeriod)
+    {
+        return;
+    }
+    this->g_lastSample = now;
+
+    //The samples and the levels keep their capacity, only a resize allocates
+    this->g_samples.push_back(this->_value.load(std::memory_order_relaxed));
+    auto const pointCount = std::max<std::size_t>(this->getPointCount(), 1);
+    if (this->g_samples.size() > pointCount)
+    {
+        this->g_samples.erase(this->g_samples.begin(),
+                              this->g_samples.end() - static_cast<std::ptrdiff_t>(pointCount));
+    }
+
+    this->computeLevels(this->g_nextLevels);
+    if (this->g_nextLevels != this->g_levels)
+    {
+        this->g_levels.swap(this->g_nextLevels);
+        this->invalidate();
+    }
+}
+
+std::size_t Sparkline::getPointCount() const
+{
+    std::size_t const labelWidth = this->g_label.empty() ? 0 : GetTextWidth(this->g_label) + 1;
+    return this->getRect()._width > labelWidth ? this->getRect()._width - labelWidth : 0;
+}
+void Sparkline::computeLevels(std::string& levels) const
+{
+    levels.clear();
+
+    auto const count = std::min(this->g_samples.size(), this->getPointCount());
+    auto const begin = this->g_samples.end() - static_cast<std::ptrdiff_t>(count);
+
+    double min = this->g_min;
+    double max = this->g_max;
+    if (min == max && count != 0)
+    {
+        auto const range = std::minmax_element(begin, this->g_samples.end());
+        min = *range.first;
+        max = *range.second;
+    }
+
+    for (auto it=begin; it!=this->g_samples.end(); ++it)
+    {
+        double const ratio = max == min ? 0.0 : std::clamp((*it - min) / (max - min), 0.0, 1.0);
+        levels.push_back(static_cast<char>(ratio * 7.0 + 0.5));
+    }
+}
+
+void TableBatch::setInteger(uint64_t key, std::size_t column, int64_t value)
+{
+    auto& entry = this->g_entries.emplace_back();
+    entry._key = key;
+    entry._column = static_cast<uint32_t>(column);
+    entry._operation = Operation::INTEGER;
+    entry._integer = value;
+}
+void TableBatch::setFloat(uint64_t key, std::size_t column, double value)
+{
+    auto& entry = this->g_entries.emplace_back();
+    entry._key = key;
+    entry._column = static_cast<uint32_t>(column);
+    entry._operation = Operation::FLOAT;
+    entry._float = value;
+}
+void TableBatch::setText(uint64_t key, std::size_t column, std::string_view value)
+{
+    auto& entry = this->g_entries.emplace_back();
+    entry._key = key;
+    entry._column = static_cast<uint32_t>(column);
+    entry._operation = Operation::TEXT;
+    entry._text._offset = static_cast<uint32_t>(this->g_texts.size());
+    entry._text._size = static_cast<uint32_t>(value.size());
+    this->g_texts.append(value);
+}
+void TableBatch::removeRow(uint64_t key)
+{
+    auto& entry = this->g_entries.emplace_back();
+    entry._key = key;
+    entry._column = 0;
+    entry._operation = Operation::REMOVE;
+    entry._integer = 0;
+}
+
+void TableBatch::clear()
+{
+    this->g_entries.clear();
+    this->g_texts.clear();
+}
+bool TableBatch::isEmpty() const
+{
+    return this->g_entries.empty();
+}
+
+void Table::render(std::ostream& stream) const
+{
+    std::scoped_lock const lock(this->g_mutex);
+
+    auto const& rect = this->getRect();
+    if (rect.isEmpty())
+    {
+        return;
+    }
+
+    //Visible columns with their displayed width, the last one can be partially visible
+    auto& columns = this->g_renderColumns;
+    columns.clear();
+    std::size_t used = 0;
+    for (std::size_t i=this->g_scrollColumn; i<this->g_columns.size() && used<rect._width; ++i)
+    {
+        auto const width = std::min<std::size_t>(this->g_columns[i]._width, rect._width - used);
+        columns.emplace_back(i, width);
+        used += width;
+        if (used < rect._width)
+        {
+            ++used; //Separator
+        }
+    }
+
+    auto& line = this->g_renderLine;
+    line.clear();
+    line += csi::Sgr<47, 30>;
+    for (std::size_t i=0; i<columns.size(); ++i)
+    {
+        if (i != 0)
+        {
+            line += ' ';
+        }
+        auto const& column = this->g_columns[columns[i].first];
+        AppendFitted(line, column._name, columns[i].second, column._type != ColumnType::TEXT);
+    }
+    line += csi::ColorNormal;
+    line += '\n';
+    stream << line;
+
+    //The order is read directly, a row removed since the last update is already out of it
+    auto block = this->g_blocks.begin();
+    std::size_t index = this->g_scrollRow;
+    while (block != this->g_blocks.end() && index >= (*block)->_slots.size())
+    {
+        index -= (*block)->_slots.size();
+        ++block;
+    }
+
+    std::size_t const rows = rect._height - 1u;
+    for (std::size_t row=0; row<rows && block!=this->g_blocks.end(); ++row)
+    {
+        auto const slot = (*block)->_slots[index];
+        if (++index == (*block)->_slots.size())
+        {
+            index = 0;
+            ++block;
+        }
+
+        line.clear();
+        for (std::size_t i=0; i<columns.size(); ++i)
+        {
+            if (i != 0)
+            {
+                line += ' ';
+            }
+
+            auto const& column = this->g_columns[columns[i].first];
+            if (column._dirty[slot] != 0)
+            {
+                this->encodeCell(column, slot);
+            }
+
+            auto const& encoded = column._encoded[slot];
+            if (columns[i].second == column._width)
+            {
+                line += encoded;
+            }
+            else
+            {
+                AppendFitted(line, encoded, columns[i].second, false);
+            }
+        }
+        line += '\n';
+        stream << line;
+    }
+}
+
+std::size_t Table::addColumn(std::string_view name, ColumnType type, uint16_t width, int precision)
+{
+    std::size_t index;
+    {
+        std::scoped_lock const lock(this->g_mutex);
+
+        auto const rowCount = this->g_keys.size();
+        auto& column = this->g_columns.emplace_back();
+        column._name = name;
+        column._type = type;
+        column._width = width;
+        column._precision = precision;
+        switch (type)
+        {
+        case ColumnType::INTEGER:
+            column._integers.resize(rowCount, 0);
+            break;
+        case ColumnType::FLOAT:
+            column._floats.resize(rowCount, 0.0);
+            break;
+        case ColumnType::TEXT:
+            column._texts.resize(rowCount);
+            break;
+        }
+        column._encoded.resize(rowCount);
+        column._dirty.resize(rowCount, 1);
+        index = this->g_columns.size() - 1;
+    }
+    this->invalidate();
+    return index;
+}
+std::size_t Table::getColumnCount() const
+{
+    std::scoped_lock const lock(this->g_mutex);
+    return this->g_columns.size();
+}
+std::size_t Table::getRowCount() const
+{
+    std::scoped_lock const lock(this->g_mutex);
+    return this->g_keys.size();
+}
+
+void Table::apply(TableBatch const& batch)
+{
+    bool needInvalidate = false;
+    {
+        std::scoped_lock const lock(this->g_mutex);
+
+        for (auto const& entry : batch.g_entries)
+        {
+            if (entry._operation == TableBatch::Operation::REMOVE)
+            {
+                auto it = this->g_slots.find(entry._key);
+                if (it != this->g_slots.end() && this->removeRowSlot(it->second))
+                {
+                    needInvalidate = true;
+                }
+                continue;
+            }
+
+            if (entry._column >= this->g_columns.size())
+            {
+                continue;
+            }
+
+            auto const slot = this->getOrCreateRow(entry._key);
+            auto& column = this->g_columns[entry._column];
+
+            bool changed = false;
+            switch (column._type)
+            {
+            case ColumnType::INTEGER:
+            {
+                int64_t value;
+                if (entry._operation == TableBatch::Operation::INTEGER)
+                {
+                    value = entry._integer;
+                }
+                else if (entry._operation == TableBatch::Operation::FLOAT)
+                {
+                    value = static_cast<int64_t>(entry._float);
+                }
+                else
+                {
+                    break;
+                }
+                changed = column._integers[slot] != value;
+                column._integers[slot] = value;
+                break;
+            }
+            case ColumnType::FLOAT:
+            {
+                double value;
+                if (entry._operation == TableBatch::Operation::FLOAT)
+                {
+                    value = entry._float;
+                }
+                else if (entry._operation == TableBatch::Operation::INTEGER)
+                {
+                    value = static_cast<double>(entry._integer);
+                }
+                else
+                {
+                    break;
+                }
+                changed = column._floats[slot] != value;
+                column._floats[slot] = value;
+                break;
+            }
+            case ColumnType::TEXT:
+                if (entry._operation == TableBatch::Operation::TEXT)
+                {
+                    std::string_view const value{batch.g_texts.data() + entry._text._offset, entry._text._size};
+                    changed = column._texts[slot] != value;
+                    if (changed)
+                    {
+                        column._texts[slot] = value;
+                    }
+                }
+                break;
+            }
+
+            if (!changed)
+            {
+                continue;
+            }
+
+            column._dirty[slot] = 1;
+            if (entry._column == this->g_sortColumn && this->g_changed[slot] == 0)
+            {
+                this->g_changed[slot] = 1;
+                this->g_changedSlots.push_back(slot);
+            }
+            needInvalidate = needInvalidate || this->isVisible(slot);
+        }
+    }
+
+    //The terminal is locked after the table to not invert the lock order with render()
+    if (needInvalidate)
+    {
+        this->invalidate();
+    }
+}
+void Table::clear()
+{
+    {
+        std::scoped_lock const lock(this->g_mutex);
+        for (auto& column : this->g_columns)
+        {
+            column._integers.clear();
+            column._floats.clear();
+            column._texts.clear();
+            column._encoded.clear();
+            column._dirty.clear();
+        }
+        this->g_keys.clear();
+        this->g_slots.clear();
+        this->g_blocks.clear();
+        this->g_slotBlocks.clear();
+        this->g_changed.clear();
+        this->g_changedSlots.clear();
+        this->g_rebuildOrder = false;
+        this->g_visible.clear();
+        this->g_visibleSlots.clear();
+        this->g_scrollRow = 0;
+    }
+    this->invalidate();
+}
+
+void Table::sortBy(std::size_t column, bool ascending)
+{
+    {
+        std::scoped_lock const lock(this->g_mutex);
+        this->g_sortColumn = column < this->g_columns.size() ? column : NoSortColumn;
+        this->g_ascending = ascending;
+        this->g_rebuildOrder = true;
+    }
+    this->invalidate();
+}
+void Table::sortByKey()
+{
+    this->sortBy(NoSortColumn);
+}
+
+void Table::setScrollRow(std::size_t row)
+{
+    {
+        std::scoped_lock const lock(this->g_mutex);
+        this->g_scrollRow = row;
+        this->refreshVisible();
+    }
+    this->invalidate();
+}
+std::size_t Table::getScrollRow() const
+{
+    std::scoped_lock const lock(this->g_mutex);
+    return this->g_scrollRow;
+}
+bool Table::scrollToKey(uint64_t key)
+{
+    {
+        std::scoped_lock const lock(this->g_mutex);
+        auto it = this->g_slots.find(key);
+        if (it == this->g_slots.end() || this->g_slotBlocks[it->second] == nullptr)
+        {
+            return false;
+        }
+        this->g_scrollRow = this->getPosition(it->second);
+        this->refreshVisible();
+    }
+    this->invalidate();
+    return true;
+}
+void Table::setScrollColumn(std::size_t column)
+{
+    {
+        std::scoped_lock const lock(this->g_mutex);
+        this->g_scrollColumn = column;
+    }
+    this->invalidate();
+}
+std::size_t Table::getScrollColumn() const
+{
+    std::scoped_lock const lock(this->g_mutex);
+    return this->g_scrollColumn;
+}
+
+void Table::onUpdate()
+{
+    std::scoped_lock const lock(this->g_mutex);
+
+    //Many changes are cheaper to sort again than to move one by one
+    if (this->g_changedSlots.size() > this->g_keys.size() / 16 + 16)
+    {
+        this->g_rebuildOrder = true;
+    }
+
+    auto const height = this->getRect()._height;
+    std::size_t const rows = height > 0 ? height - 1u : 0u;
+    bool windowChanged = rows != this->g_visibleRows;
+    this->g_visibleRows = rows;
+
+    if (this->g_rebuildOrder)
+    {
+        this->rebuildOrder();
+        windowChanged = true;
+    }
+    else if (!this->g_changedSlots.empty())
+    {
+        //Take the rows whose sort value changed out of the order and insert them back,
+        //the window changes only when one of them is before its end
+        for (auto slot : this->g_changedSlots)
+        {
+            if (this->g_slotBlocks[slot] != nullptr)
+            {
+                windowChanged = windowChanged || this->isBeforeWindowEnd(slot);
+                this->eraseOrdered(slot);
             }
         }
+        for (auto slot : this->g_changedSlots)
+        {
+            this->insertOrdered(slot);
+            windowChanged = windowChanged || this->isBeforeWindowEnd(slot);
+            this->g_changed[slot] = 0;
+        }
+        this->g_changedSlots.clear();
+    }
+
+    if (windowChanged)
+    {
+        this->refreshVisible();
+        this->invalidate();
+    }
+}
+
+uint32_t Table::getOrCreateRow(uint64_t key)
+{
+    auto const result = this->g_slots.try_emplace(key, static_cast<uint32_t>(this->g_keys.size()));
+    if (!result.second)
+    {
+        return result.first->second;
+    }
+
+    this->g_keys.push_back(key);
+    for (auto& column : this->g_columns)
+    {
+        switch (column._type)
+        {
+        case ColumnType::INTEGER:
+            column._integers.push_back(0);
+            break;
+        case ColumnType::FLOAT:
+            column._floats.push_back(0.0);
+            break;
+        case ColumnType::TEXT:
+            column._texts.emplace_back();
+            break;
+        }
+        column._encoded.emplace_back();
+        column._dirty.push_back(1);
     }
-#else
-    winsize w{};
-    if ( ioctl(this->g_internalOutputHandle._desc, TIOCGWINSZ, &w) == 0 )
-    {///TODO not great, I prefer events
-        BufferSize newSize = {static_cast<BufferSize::ValueType>(w.ws_col),
-            static_cast<BufferSize::ValueType>(w.ws_row};
 
-        if (newSize != this->g_bufferSize)
+    //Positioned by the next update
+    this->g_slotBlocks.push_back(nullptr);
+    this->g_changed.push_back(1);
+    this->g_changedSlots.push_back(result.first->second);
+    this->g_visible.push_back(0);
+    return result.first->second;
+}
+bool Table::removeRowSlot(uint32_t slot)
+{
+    //The row leaves the order right away so a render never reads a removed slot
+    bool const windowChanged = this->g_slotBlocks[slot] != nullptr && this->isBeforeWindowEnd(slot);
+    if (windowChanged)
+    {
+        for (auto visible : this->g_visibleSlots)
+        {
+            this->g_visible[visible] = 0;
+        }
+        this->g_visibleSlots.clear();
+    }
+    this->eraseOrdered(slot);
+    if (this->g_changed[slot] != 0)
+    {
+        this->g_changedSlots.erase(std::find(this->g_changedSlots.begin(), this->g_changedSlots.end(), slot));
+    }
+
+    //The last row takes the place of the removed one
+    auto const last = static_cast<uint32_t>(this->g_keys.size() - 1);
+    this->g_slots.erase(this->g_keys[slot]);
+
+    if (slot != last)
+    {
+        for (auto& column : this->g_columns)
         {
-            this->g_bufferSize = newSize;
-            for (auto& element : this->g_elements)
+            switch (column._type)
             {
-                element->onSizeChanged(this->g_bufferSize);
+            case ColumnType::INTEGER:
+                column._integers[slot] = column._integers[last];
+                break;
+            case ColumnType::FLOAT:
+                column._floats[slot] = column._floats[last];
+                break;
+            case ColumnType::TEXT:
+                column._texts[slot] = std::move(column._texts[last]);
+                break;
             }
+            column._encoded[slot] = std::move(column._encoded[last]);
+            column._dirty[slot] = column._dirty[last];
+        }
+        this->g_keys[slot] = this->g_keys[last];
+        this->g_slots[this->g_keys[slot]] = slot;
+
+        auto* const block = this->g_slotBlocks[last];
+        if (block != nullptr)
+        {
+            *std::find(block->_slots.begin(), block->_slots.end(), last) = slot;
+        }
+        this->g_slotBlocks[slot] = block;
+
+        this->g_changed[slot] = this->g_changed[last];
+        if (this->g_changed[slot] != 0)
+        {
+            *std::find(this->g_changedSlots.begin(), this->g_changedSlots.end(), last) = slot;
+        }
+        this->g_visible[slot] = this->g_visible[last];
+        if (this->g_visible[slot] != 0)
+        {
+            *std::find(this->g_visibleSlots.begin(), this->g_visibleSlots.end(), last) = slot;
         }
     }
 
-    uint8_t buffer[10];
-    auto result = read(this->g_internalInputHandle._desc, &buffer, 10);
-    if (result == -1 || result == 0)
+    for (auto& column : this->g_columns)
     {
-        return;
+        switch (column._type)
+        {
+        case ColumnType::INTEGER:
+            column._integers.pop_back();
+            break;
+        case ColumnType::FLOAT:
+            column._floats.pop_back();
+            break;
+        case ColumnType::TEXT:
+            column._texts.pop_back();
+            break;
+        }
+        column._encoded.pop_back();
+        column._dirty.pop_back();
     }
+    this->g_keys.pop_back();
+    this->g_slotBlocks.pop_back();
+    this->g_changed.pop_back();
+    this->g_visible.pop_back();
 
-    for (decltype(result) i=0; i<result; ++i)
+    if (windowChanged)
     {
-        auto c = static_cast<char>(buffer[i]);
+        this->refreshVisible();
+    }
+    return windowChanged;
+}
 
-        KeyEvent keyEvent{true, 1,
-                          0, 0,
-                          c, 0};
+void Table::rebuildOrder()
+{
+    std::vector<uint32_t> order(this->g_keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b){ return this->isLess(a, b); });
 
-        for (auto& element : this->g_elements)
+    this->g_blocks.clear();
+    for (std::size_t i=0; i<order.size(); i+=OrderBlockSize)
+    {
+        auto& block = *this->g_blocks.emplace_back(std::make_unique<OrderBlock>());
+        block._slots.reserve(OrderBlockSize * 2 + 1);
+        block._slots.assign(order.begin() + static_cast<std::ptrdiff_t>(i),
+                            order.begin() + static_cast<std::ptrdiff_t>(std::min(i + OrderBlockSize, order.size())));
+        for (auto slot : block._slots)
         {
-            if (element->haveInputStream())
-            {
-                element->onKeyInput(keyEvent);
-            }
+            this->g_slotBlocks[slot] = &block;
         }
     }
-#endif //_WIN32
+
+    std::fill(this->g_changed.begin(), this->g_changed.end(), 0);
+    this->g_changedSlots.clear();
+    this->g_rebuildOrder = false;
 }
-void Terminal::render() const
+void Table::insertOrdered(uint32_t slot)
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
+    if (this->g_blocks.empty())
+    {
+        this->g_blocks.emplace_back(std::make_unique<OrderBlock>())->_slots.reserve(OrderBlockSize * 2 + 1);
+    }
 
-    if (!this->g_invalidRender)
+    //First block whose last row is not before the slot, blocks are never empty
+    auto const less = [this](uint32_t a, uint32_t b){ return this->isLess(a, b); };
+    auto it = std::partition_point(this->g_blocks.begin(), this->g_blocks.end() - 1,
+                                   [&](auto const& block){ return less(block->_slots.back(), slot); });
+
+    auto& slots = (*it)->_slots;
+    slots.insert(std::lower_bound(slots.begin(), slots.end(), slot, less), slot);
+    this->g_slotBlocks[slot] = it->get();
+
+    if (slots.size() > OrderBlockSize * 2)
+    {
+        auto next = std::make_unique<OrderBlock>();
+        next->_slots.reserve(OrderBlockSize * 2 + 1);
+        next->_slots.assign(slots.begin() + OrderBlockSize, slots.end());
+        slots.resize(OrderBlockSize);
+        for (auto moved : next->_slots)
+        {
+            this->g_slotBlocks[moved] = next.get();
+        }
+        this->g_blocks.insert(it + 1, std::move(next));
+    }
+}
+void Table::eraseOrdered(uint32_t slot)
+{
+    auto* const block = this->g_slotBlocks[slot];
+    if (block == nullptr)
     {
         return;
     }
-    this->g_invalidRender = false;
+    block->_slots.erase(std::find(block->_slots.begin(), block->_slots.end(), slot));
+    this->g_slotBlocks[slot] = nullptr;
 
-    this->g_internalOutputStream << CSI_CURSOR_POSITION(1, 1) << CSI_ERASE_DISPLAY(0) << CSI_ERASE_DISPLAY(3);
-    if (this->g_rowOffset > 0)
+    //A small block is merged into a neighbour that can take it without being split,
+    //repeated removals would otherwise leave the order fragmented in many tiny blocks
+    if (block->_slots.size() >= OrderBlockSize / 2)
     {
-        this->g_internalOutputStream << CSI_CURSOR_POSITION_STREAM(this->g_rowOffset+1, 1);
+        return;
     }
+    auto it = std::find_if(this->g_blocks.begin(), this->g_blocks.end(),
+                           [block](auto const& other){ return other.get() == block; });
 
-    for (const auto& element : this->g_elements)
+    OrderBlock* target = nullptr;
+    if (it != this->g_blocks.begin() && (*(it - 1))->_slots.size() + block->_slots.size() <= OrderBlockSize * 2)
     {
-        element->render(this->g_internalOutputStream);
+        target = (it - 1)->get();
+        target->_slots.insert(target->_slots.end(), block->_slots.begin(), block->_slots.end());
     }
-    this->g_internalOutputStream << std::flush;
+    else if (it + 1 != this->g_blocks.end() && (*(it + 1))->_slots.size() + block->_slots.size() <= OrderBlockSize * 2)
+    {
+        target = (it + 1)->get();
+        target->_slots.insert(target->_slots.begin(), block->_slots.begin(), block->_slots.end());
+    }
+    else if (!block->_slots.empty())
+    {
+        return;
+    }
+
+    for (auto moved : block->_slots)
+    {
+        this->g_slotBlocks[moved] = target;
+    }
+    this->g_blocks.erase(it);
 }
-void Terminal::invalidate() const
+std::size_t Table::getPosition(uint32_t slot) const
 {
-    std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
-    this->g_invalidRender = true;
+    auto const* const block = this->g_slotBlocks[slot];
+    std::size_t position = 0;
+    for (auto const& other : this->g_blocks)
+    {
+        if (other.get() == block)
+        {
+            return position + static_cast<std::size_t>(std::find(block->_slots.begin(), block->_slots.end(), slot) -
+                                                       block->_slots.begin());
+        }
+        position += other->_slots.size();
+    }
+    return position;
+}
+bool Table::isBeforeWindowEnd(uint32_t slot) const
+{
+    //Only the blocks up to the end of the window are walked
+    auto const* const block = this->g_slotBlocks[slot];
+    auto const windowEnd = this->g_scrollRow + this->g_visibleRows;
+    std::size_t position = 0;
+    for (auto const& other : this->g_blocks)
+    {
+        if (position >= windowEnd)
+        {
+            return false;
+        }
+        if (other.get() == block)
+        {
+            return position + static_cast<std::size_t>(std::find(block->_slots.begin(), block->_slots.end(), slot) -
+                                                       block->_slots.begin()) < windowEnd;
+        }
+        position += other->_slots.size();
+    }
+    return false;
 }
+void Table::refreshVisible()
+{
+    for (auto slot : this->g_visibleSlots)
+    {
+        this->g_visible[slot] = 0;
+    }
+    this->g_visibleSlots.clear();
 
-void Terminal::setRowOffset(uint16_t offset)
+    std::size_t skip = this->g_scrollRow;
+    for (auto const& block : this->g_blocks)
+    {
+        if (this->g_visibleSlots.size() >= this->g_visibleRows)
+        {
+            break;
+        }
+        if (skip >= block->_slots.size())
+        {
+            skip -= block->_slots.size();
+            continue;
+        }
+        for (std::size_t i=skip; i<block->_slots.size() && this->g_visibleSlots.size()<this->g_visibleRows; ++i)
+        {
+            this->g_visible[block->_slots[i]] = 1;
+            this->g_visibleSlots.push_back(block->_slots[i]);
+        }
+        skip = 0;
+    }
+}
+bool Table::isVisible(uint32_t slot) const
 {
-    this->g_rowOffset = offset;
+    return this->g_visible[slot] != 0;
 }
-uint16_t Terminal::getRowOffset() const
+bool Table::isLess(uint32_t a, uint32_t b) const
 {
-    return this->g_rowOffset;
+    if (this->g_sortColumn != NoSortColumn)
+    {
+        auto const& column = this->g_columns[this->g_sortColumn];
+        int compare = 0;
+        switch (column._type)
+        {
+        case ColumnType::INTEGER:
+            compare = column._integers[a] < column._integers[b] ? -1 : (column._integers[b] < column._integers[a] ? 1 : 0);
+            break;
+        case ColumnType::FLOAT:
+            compare = column._floats[a] < column._floats[b] ? -1 : (column._floats[b] < column._floats[a] ? 1 : 0);
+            break;
+        case ColumnType::TEXT:
+            compare = column._texts[a].compare(column._texts[b]);
+            break;
+        }
+        if (compare != 0)
+        {
+            return this->g_ascending ? compare < 0 : compare > 0;
+        }
+    }
+    return this->g_keys[a] < this->g_keys[b];
 }
-
-void TextOutputStream::render(std::ostream& stream) const
+void Table::encodeCell(Column const& column, uint32_t slot) const
 {
-    for (const auto& str : this->g_textBuffer)
+    char buffer[64];
+    std::string_view text;
+    switch (column._type)
     {
-        stream << str;
+    case ColumnType::INTEGER:
+        text = {buffer, static_cast<std::size_t>(std::to_chars(buffer, buffer+sizeof(buffer), column._integers[slot]).ptr - buffer)};
+        break;
+    case ColumnType::FLOAT:
+    {
+        auto const size = std::snprintf(buffer, sizeof(buffer), "%.*f", column._precision, column._floats[slot]);
+        text = {buffer, static_cast<std::size_t>(std::clamp(size, 0, static_cast<int>(sizeof(buffer)-1)))};
+        break;
+    }
+    case ColumnType::TEXT:
+        text = column._texts[slot];
+        break;
     }
+
+    auto& encoded = column._encoded[slot];
+    encoded.clear();
+    AppendFitted(encoded, text, column._width, column._type != ColumnType::TEXT);
+    column._dirty[slot] = 0;
 }
 
-void TextOutputStream::setBufferLimit(std::size_t limit)
+SessionReplay::~SessionReplay()
 {
-    this->g_bufferLimit = limit;
+    this->close();
 }
-std::size_t TextOutputStream::getBufferLimit() const
+
+bool SessionReplay::open(std::string const& path)
 {
-    return this->g_bufferLimit;
+    this->close();
+
+    this->g_file = std::fopen(path.c_str(), "rb");
+    if (this->g_file == nullptr)
+    {
+        return false;
+    }
+
+    char header[sizeof(Magic) + 1];
+    if (std::fread(header, 1, sizeof(header), this->g_file) != sizeof(header) ||
+        std::memcmp(header, Magic, sizeof(Magic)) != 0 || static_cast<uint8_t>(header[sizeof(Magic)]) != Version)
+    {
+        this->close();
+        return false;
+    }
+
+    long size = -1;
+    if (std::fseek(this->g_file, 0, SEEK_END) != 0 || (size = std::ftell(this->g_file)) < 0 ||
+        std::fseek(this->g_file, static_cast<long>(sizeof(header)), SEEK_SET) != 0)
+    {
+        this->close();
+        return false;
+    }
+    this->g_fileSize = static_cast<uint64_t>(size);
+    this->g_malformed = false;
+
+    this->g_timestamp = std::chrono::microseconds{0};
+    this->g_start = std::chrono::steady_clock::now();
+    this->g_eventCount = 0;
+    this->g_frameCount = 0;
+    return true;
+}
+void SessionReplay::close()
+{
+    if (this->g_file != nullptr)
+    {
+        std::fclose(this->g_file);
+        this->g_file = nullptr;
+    }
+    this->g_channels.clear();
 }
 
-void TextOutputStream::clear()
+void SessionReplay::setSpeed(double speed)
+{
+    this->g_speed = speed;
+}
+double SessionReplay::getSpeed() const
 {
-    this->g_textBuffer.clear();
-    this->getTerminal()->invalidate();
+    return this->g_speed;
 }
 
-void TextOutputStream::onInput(std::string_view str)
+bool SessionReplay::step(Terminal& terminal)
 {
-    this->g_textBuffer.emplace_back(str);
-    if (this->g_bufferLimit != 0 &&
-        this->g_textBuffer.size() > this->g_bufferLimit)
+    if (this->g_file == nullptr)
+    {
+        return false;
+    }
+
+    auto const type = std::fgetc(this->g_file);
+    if (type == EOF)
+    {
+        return false;
+    }
+    uint64_t delta = 0;
+    if (!this->readVarint(delta))
+    {
+        this->g_malformed = true;
+        return false;
+    }
+
+    if (this->g_eventCount == 0)
+    {
+        this->g_start = std::chrono::steady_clock::now();
+    }
+    this->g_timestamp += std::chrono::microseconds{delta};
+    if (this->g_speed > 0.0)
+    {
+        auto const offset = std::chrono::duration<double, std::micro>(static_cast<double>(this->g_timestamp.count()) / this->g_speed);
+        std::this_thread::sleep_until(this->g_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset));
+    }
+
+    if (!this->replayEvent(terminal, static_cast<EventType>(type)))
     {
-        this->g_textBuffer.erase(this->g_textBuffer.begin());
+        this->g_malformed = true;
+        return false;
     }
-    this->getTerminal()->invalidate();
+
+    ++this->g_eventCount;
+    return true;
+}
+void SessionReplay::play(Terminal& terminal)
+{
+    while (this->step(terminal));
 }
 
-void TextInputStream::render(std::ostream& stream) const
+std::size_t SessionReplay::getEventCount() const
+{
+    return this->g_eventCount;
+}
+std::size_t SessionReplay::getFrameCount() const
+{
+    return this->g_frameCount;
+}
+std::chrono::microseconds SessionReplay::getTimestamp() const
 {
-    stream << CSI_COLOR_FG_GREEN "INPUT> " CSI_COLOR_NORMAL << this->g_inputBuffer;
+    return this->g_timestamp;
+}
+bool SessionReplay::isMalformed() const
+{
+    return this->g_malformed;
 }
 
-void TextInputStream::onKeyInput(KeyEvent const& keyEvent)
+bool SessionReplay::replayEvent(Terminal& terminal, EventType type)
 {
-    if (keyEvent._keyDown)
+    switch (type)
     {
-        //Enter
-#ifdef _WIN32
-        if (keyEvent._asciiChar == '\r')
-#else
-        if (keyEvent._asciiChar == '\n')
-#endif //_WIN32
+    case EventType::CHANNEL:
+    {
+        uint64_t id = 0;
+        if (!this->readVarint(id) || id == 0 || id > MaxChannelId || !this->readString(this->g_buffer))
         {
-            if (this->g_inputBuffer.empty())
-            {
-                return;
-            }
-
-            this->getTerminal()->output("%s\n", this->g_inputBuffer.c_str());
-
-            this->_onInput.call(this->g_inputBuffer);
-            this->g_inputBuffer.clear();
-            this->getTerminal()->invalidate();
-            return;
+            return false;
         }
-        //Backspace
-#ifdef _WIN32
-        else if (keyEvent._asciiChar == '\b')
-#else
-        else if (keyEvent._asciiChar == 127)
-#endif //_WIN32
+        if (this->g_channels.size() <= id)
         {
-            if (!this->g_inputBuffer.empty())
-            {
-                this->g_inputBuffer.pop_back();
-                this->getTerminal()->invalidate();
-            }
-            return;
+            this->g_channels.resize(id + 1);
         }
-        //Unhandled control
-        else if (iscntrl(keyEvent._asciiChar) != 0)
+        this->g_channels[id] = terminal.channel(this->g_buffer);
+        break;
+    }
+    case EventType::OUTPUT:
+    {
+        uint64_t id = 0;
+        if (!this->readVarint(id) || !this->readString(this->g_buffer))
         {
-            return;
+            return false;
         }
-
-        this->g_inputBuffer.push_back(keyEvent._asciiChar);
-        this->getTerminal()->invalidate();
+        if (id != 0 && id < this->g_channels.size())
+        {
+            this->g_channels[id].outputText(this->g_buffer);
+        }
+        else
+        {
+            terminal.outputText(this->g_buffer);
+        }
+        break;
     }
-}
-
-Banner::Banner(std::string_view banner) :
-        g_banner{banner}
-{}
-
-void Banner::render(std::ostream& stream) const
-{
-    this->getTerminal()->saveCursorPosition();
-    if (this->g_centered)
+    case EventType::KEY:
     {
-        auto size = this->getTerminal()->getTerminalBufferSize();
-        unsigned int col = this->g_banner.size() >= size._width ? 1 : ((size._width - this->g_banner.size())/2 + 1);
-        stream << CSI_CURSOR_POSITION_STREAM(1, col);
+        uint64_t repeatCount = 0;
+        uint64_t virtualKeyCode = 0;
+        uint64_t virtualScanCode = 0;
+        uint64_t controlKeyState = 0;
+        auto const keyDown = std::fgetc(this->g_file);
+        if (keyDown == EOF || !this->readVarint(repeatCount) ||
+            !this->readVarint(virtualKeyCode) || !this->readVarint(virtualScanCode))
+        {
+            return false;
+        }
+        auto const asciiChar = std::fgetc(this->g_file);
+        if (asciiChar == EOF || !this->readVarint(controlKeyState))
+        {
+            return false;
+        }
+        terminal.replayKeyEvent({keyDown != 0, static_cast<uint16_t>(repeatCount),
+                               static_cast<uint16_t>(virtualKeyCode), static_cast<uint16_t>(virtualScanCode),
+                               static_cast<char>(asciiChar), static_cast<uint32_t>(controlKeyState)});
+        break;
     }
-    else
+    case EventType::RESIZE:
+    {
+        uint64_t width = 0;
+        uint64_t height = 0;
+        if (!this->readVarint(width) || !this->readVarint(height))
+        {
+            return false;
+        }
+        terminal.setTerminalBufferSize({static_cast<BufferSize::ValueType>(width),
+                                        static_cast<BufferSize::ValueType>(height)});
+        break;
+    }
+    case EventType::FRAME:
     {
-        stream << CSI_CURSOR_POSITION(1, 1);
+        uint64_t size = 0;
+        if (!this->readVarint(size) || !this->skip(size))
+        {
+            return false;
+        }
+        terminal.update();
+        terminal.render();
+        ++this->g_frameCount;
+        break;
+    }
+    default:
+        return false;
     }
-    stream << CSI_COLOR_BG_WHITE << CSI_COLOR_FG_BLACK;
-    stream << ' ' << this->g_banner << ' ' << CSI_COLOR_NORMAL;
-    this->getTerminal()->restoreCursorPosition();
+    return true;
 }
 
-void Banner::setBanner(std::string_view banner)
+bool SessionReplay::readVarint(uint64_t& value)
 {
-    this->g_banner = banner;
-    this->getTerminal()->invalidate();
+    value = 0;
+    for (unsigned int shift=0; shift<64; shift+=7)
+    {
+        auto const c = std::fgetc(this->g_file);
+        if (c == EOF)
+        {
+            return false;
+        }
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if ((c & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
-std::string const& Banner::getBanner() const
+bool SessionReplay::readString(std::string& str)
 {
-    return this->g_banner;
+    uint64_t size = 0;
+    if (!this->readVarint(size))
+    {
+        return false;
+    }
+    if (size > this->getRemainingSize())
+    {
+        return false;
+    }
+    str.resize(static_cast<std::size_t>(size));
+    return std::fread(str.data(), 1, str.size(), this->g_file) == str.size();
 }
-
-void Banner::setCenterFlag(bool centered)
+bool SessionReplay::skip(uint64_t size)
 {
-    this->g_centered = centered;
-    this->getTerminal()->invalidate();
+    return size <= this->getRemainingSize() && std::fseek(this->g_file, static_cast<long>(size), SEEK_CUR) == 0;
 }
-bool Banner::isCentered() const
+uint64_t SessionReplay::getRemainingSize() const
 {
-    return this->g_centered;
+    auto const position = std::ftell(this->g_file);
+    if (position < 0 || static_cast<uint64_t>(position) > this->g_fileSize)
+    {
+        return 0;
+    }
+    return this->g_fileSize - static_cast<uint64_t>(position);
 }
 
-} //namespace gt
\ No newline at end of file
+} //namespace gt
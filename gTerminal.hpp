@@ -27,15 +27,31 @@
 #include <string>
 #include <string_view>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <memory_resource>
 #include <list>
+#include <deque>
 #include <vector>
+#include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <type_traits>
 #include <ostream>
+#include <cstdio>
+#include <sstream>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+    #define GTERMINAL_COROUTINES
+    #include <coroutine>
+    #include <exception>
+#endif
 
 #ifndef _WIN32
     #define GTERMINAL_API
+    struct pollfd;
 #else
     #ifdef GTERMINAL_EXPORTS
         #define GTERMINAL_API __declspec(dllexport)
@@ -44,34 +60,124 @@
     #endif //GTERMINAL_EXPORTS
 #endif //_WIN32
 
-#define CSI_ERASE_DISPLAY(_n) ("\x1b[" #_n "J")
-#define CSI_CURSOR_POSITION(_row, _col) ("\x1b[" #_row ";" #_col "H")
-#define CSI_CURSOR_POSITION_STREAM(_row, _col) "\x1b[" << _row << ';' << _col << 'H'
-
-#define CSI_SAVE_CURSOR_POSITION "\x1b[s"
-#define CSI_RESTORE_CURSOR_POSITION "\x1b[u"
-
-#define CSI_COLOR_NORMAL "\x1b[0m"
-#define CSI_COLOR_FG_BLACK "\x1b[30m"
-#define CSI_COLOR_BG_BLACK "\x1b[40m"
-#define CSI_COLOR_FG_RED "\x1b[31m"
-#define CSI_COLOR_BG_RED "\x1b[41m"
-#define CSI_COLOR_FG_GREEN "\x1b[32m"
-#define CSI_COLOR_BG_GREEN "\x1b[42m"
-#define CSI_COLOR_FG_YELLOW "\x1b[33m"
-#define CSI_COLOR_BG_YELLOW "\x1b[43m"
-#define CSI_COLOR_FG_BLUE "\x1b[34m"
-#define CSI_COLOR_BG_BLUE "\x1b[44m"
-#define CSI_COLOR_FG_MAGENTA "\x1b[35m"
-#define CSI_COLOR_BG_MAGENTA "\x1b[45m"
-#define CSI_COLOR_FG_CYAN "\x1b[36m"
-#define CSI_COLOR_BG_CYAN "\x1b[46m"
-#define CSI_COLOR_FG_WHITE "\x1b[37m"
-#define CSI_COLOR_BG_WHITE "\x1b[47m"
-
 namespace gt
 {
 
+/*
+ * Control Sequence Introducer (CSI) escape sequences.
+ * Constant sequences are built at compile time, runtime ones are encoded into a caller provided buffer.
+ */
+namespace csi
+{
+
+template<std::size_t N>
+struct Sequence
+{
+    char _data[N + 1]{};
+
+    [[nodiscard]] constexpr std::size_t size() const { return N; }
+    [[nodiscard]] constexpr char const* data() const { return this->_data; }
+    [[nodiscard]] constexpr operator std::string_view() const { return {this->_data, N}; }
+};
+
+template<std::size_t N>
+inline std::ostream& operator<<(std::ostream& stream, Sequence<N> const& sequence)
+{
+    return stream.write(sequence.data(), static_cast<std::streamsize>(N));
+}
+
+[[nodiscard]] constexpr std::size_t CountDigits(unsigned int value)
+{
+    std::size_t count = 1;
+    for (; value >= 10; value /= 10)
+    {
+        ++count;
+    }
+    return count;
+}
+
+//"\x1b[" parameters separated by ';' then the final byte
+template<char TFinal, unsigned int... TParameters>
+[[nodiscard]] constexpr auto MakeSequence()
+{
+    constexpr std::size_t separators = sizeof...(TParameters) > 0 ? sizeof...(TParameters) - 1 : 0;
+    Sequence<2 + (CountDigits(TParameters) + ... + 0) + separators + 1> sequence{};
+    unsigned int const parameters[] = {TParameters..., 0};
+
+    std::size_t i = 0;
+    sequence._data[i++] = '\x1b';
+    sequence._data[i++] = '[';
+    for (std::size_t p=0; p<sizeof...(TParameters); ++p)
+    {
+        if (p != 0)
+        {
+            sequence._data[i++] = ';';
+        }
+        i += CountDigits(parameters[p]);
+        auto value = parameters[p];
+        for (std::size_t d=i; d-- > i - CountDigits(parameters[p]); value /= 10)
+        {
+            sequence._data[d] = static_cast<char>('0' + value % 10);
+        }
+    }
+    sequence._data[i] = TFinal;
+    return sequence;
+}
+
+template<unsigned int TMode>
+inline constexpr auto EraseDisplay = MakeSequence<'J', TMode>();
+template<unsigned int TRow, unsigned int TColumn>
+inline constexpr auto CursorPosition = MakeSequence<'H', TRow, TColumn>();
+
+inline constexpr auto SaveCursorPosition = MakeSequence<'s'>();
+inline constexpr auto RestoreCursorPosition = MakeSequence<'u'>();
+
+//Select Graphic Rendition
+template<unsigned int... TAttributes>
+inline constexpr auto Sgr = MakeSequence<'m', TAttributes...>();
+
+inline constexpr auto ColorNormal = Sgr<0>;
+inline constexpr auto ColorFgBlack = Sgr<30>;
+inline constexpr auto ColorBgBlack = Sgr<40>;
+inline constexpr auto ColorFgRed = Sgr<31>;
+inline constexpr auto ColorBgRed = Sgr<41>;
+inline constexpr auto ColorFgGreen = Sgr<32>;
+inline constexpr auto ColorBgGreen = Sgr<42>;
+inline constexpr auto ColorFgYellow = Sgr<33>;
+inline constexpr auto ColorBgYellow = Sgr<43>;
+inline constexpr auto ColorFgBlue = Sgr<34>;
+inline constexpr auto ColorBgBlue = Sgr<44>;
+inline constexpr auto ColorFgMagenta = Sgr<35>;
+inline constexpr auto ColorBgMagenta = Sgr<45>;
+inline constexpr auto ColorFgCyan = Sgr<36>;
+inline constexpr auto ColorBgCyan = Sgr<46>;
+inline constexpr auto ColorFgWhite = Sgr<37>;
+inline constexpr auto ColorBgWhite = Sgr<47>;
+
+//1-based cursor position, a 0 row or column is unknown
+struct Cursor
+{
+    unsigned int _row{0};
+    unsigned int _column{0};
+};
+
+//Large enough for any sequence written by the functions below with 2 parameters
+inline constexpr std::size_t MaxSequenceSize = 2 + 10 + 1 + 10 + 1;
+
+//All of them return the end of the written sequence
+GTERMINAL_API char* WriteUnsigned(char* buffer, unsigned int value);
+GTERMINAL_API char* WriteCursorPosition(char* buffer, unsigned int row, unsigned int column);
+GTERMINAL_API char* WriteSgr(char* buffer, unsigned int attribute);
+/*
+ * Write the shortest sequence moving the cursor from one position to another,
+ * choosing between relative moves (CUU/CUD/CUF/CUB), a carriage return and an absolute position (CUP).
+ * An unknown starting row always use CUP, an unknown starting column cannot be moved relatively.
+ * On a tie the absolute sequence (CUP, CHA) is written.
+ */
+GTERMINAL_API char* WriteCursorMove(char* buffer, Cursor from, Cursor to);
+
+} //namespace csi
+
 struct KeyEvent
 {
     bool _keyDown;
@@ -98,7 +204,57 @@ struct BufferSize
     }
 };
 
+struct Rect
+{
+    using ValueType = uint16_t;
+    ValueType _x;
+    ValueType _y;
+    ValueType _width;
+    ValueType _height;
+
+    [[nodiscard]] constexpr bool operator==(Rect const& other) const
+    {
+        return this->_x == other._x && this->_y == other._y &&
+               this->_width == other._width && this->_height == other._height;
+    }
+    [[nodiscard]] constexpr bool operator!=(Rect const& other) const
+    {
+        return !(*this == other);
+    }
+
+    [[nodiscard]] constexpr bool isEmpty() const
+    {
+        return this->_width == 0 || this->_height == 0;
+    }
+    [[nodiscard]] constexpr bool intersects(Rect const& other) const
+    {
+        return !this->isEmpty() && !other.isEmpty() &&
+               this->_x < other._x + other._width && other._x < this->_x + this->_width &&
+               this->_y < other._y + other._height && other._y < this->_y + this->_height;
+    }
+};
+
+//Resumed at the end of Terminal::update(), the coroutine awaitables are built on it
+struct Continuation
+{
+    void (*_resume)(void* context);
+    void* _context;
+};
+
 class Terminal;
+class Region;
+class SessionRecorder;
+class AttachServer;
+class FrameArena;
+class RawMode;
+class OutputPacer;
+class SnapshotExport;
+
+#ifdef GTERMINAL_COROUTINES
+class LineAwaitable;
+class KeyAwaitable;
+class FrameAwaitable;
+#endif //GTERMINAL_COROUTINES
 
 template<class ...TArgs>
 class CallbackHandler
@@ -149,6 +305,11 @@ private:
     std::vector<Callback> g_callbacks;
 };
 
+/*
+ * An element renders plain text lines (SGR sequences are allowed) that the terminal
+ * clips and wraps into the rectangle of its region. The rendered rows are cached and
+ * only re-rendered when the element is invalidated or its size change.
+ */
 class Element
 {
 public:
@@ -160,41 +321,371 @@ public:
     [[nodiscard]] inline virtual bool haveOutputStream() const { return false; }
     [[nodiscard]] inline virtual bool haveInputStream() const { return false; }
 
+    //Height of the region automatically created by Terminal::addElement(), 0 fill the remaining space
+    [[nodiscard]] inline virtual uint16_t getPreferredHeight() const { return 0; }
+    //When the rendered rows overflow the rectangle, keep the last ones instead of the first ones
+    [[nodiscard]] inline virtual bool isScrolling() const { return false; }
+
+    void invalidate() const;
+
     //Event
     inline virtual void onInput([[maybe_unused]] std::string_view str) {}
     inline virtual void onKeyInput([[maybe_unused]] KeyEvent const& keyEvent) {}
     inline virtual void onSizeChanged([[maybe_unused]] BufferSize size) {}
+    inline virtual void onUpdate() {}
 
     [[nodiscard]] inline Terminal* getTerminal() const { return this->g_terminal; }
+    [[nodiscard]] inline Region* getRegion() const { return this->g_region; }
+    [[nodiscard]] inline Rect const& getRect() const { return this->g_rect; }
 
 private:
     inline void setTerminal(Terminal* terminal) { this->g_terminal = terminal; }
 
     friend class Terminal;
+    friend class Region;
     Terminal* g_terminal{nullptr};
+    Region* g_region{nullptr};
+    Rect g_rect{0,0,0,0};
+
+    mutable std::vector<std::string> g_renderCache;
+    mutable Rect::ValueType g_cursorColumn{0};
+    mutable Rect::ValueType g_cursorRow{0};
+    mutable bool g_renderDirty{true};
+};
+
+/*
+ * Regions form the layout tree of a terminal. The children of a region are stacked along
+ * its direction, a child with a fixed size take that many rows/columns and the others
+ * share the remaining space by weight. Each region can hold one element that render into its rectangle.
+ */
+class GTERMINAL_API Region
+{
+public:
+    enum class Direction : uint8_t
+    {
+        ROWS,
+        COLUMNS
+    };
+
+    ~Region();
+
+    Region(Region const&) = delete;
+    Region& operator=(Region const&) = delete;
+
+    Region* addRegion(uint16_t size=0, uint16_t weight=1);
+    bool removeRegion(Region* region);
+
+    void setDirection(Direction direction);
+    [[nodiscard]] Direction getDirection() const;
+
+    void setSize(uint16_t size, uint16_t weight=1);
+    [[nodiscard]] uint16_t getSize() const;
+    [[nodiscard]] uint16_t getWeight() const;
+
+    //Relative to the parent, elements with a higher z-order are composed on top
+    void setZOrder(int16_t zOrder);
+    [[nodiscard]] int16_t getZOrder() const;
+
+    void setElement(Element* element);
+    [[nodiscard]] Element* getElement() const;
+
+    [[nodiscard]] Rect const& getRect() const;
+    [[nodiscard]] Region* getParent() const;
+
+private:
+    Region(Terminal* terminal, Region* parent, uint16_t size, uint16_t weight);
+
+    void computeLayout(Rect rect, int16_t parentZOrder, std::vector<std::pair<int16_t, Element*> >& paintOrder);
+    void detachElement();
+
+    friend class Terminal;
+    Terminal* g_terminal;
+    Region* g_parent;
+    std::vector<std::unique_ptr<Region> > g_children;
+    Element* g_element{nullptr};
+    Direction g_direction{Direction::ROWS};
+    uint16_t g_size;
+    uint16_t g_weight;
+    int16_t g_zOrder{0};
+    Rect g_rect{0,0,0,0};
+    bool g_automatic{false};
+};
+
+class ScrollbackFile;
+class ScrollbackSearch;
+class LineChunk;
+struct ScrollbackSegment;
+
+/*
+ * Point in time view of the lines of a TextOutputStream, see TextOutputStream::takeSnapshot().
+ * Written lines are never modified and the snapshot keeps their storage alive (memory chunks and
+ * scrollback segment files), it can be read from any thread while the stream keeps receiving lines.
+ * The memory resource of the stream must outlive the snapshot.
+ */
+class GTERMINAL_API OutputSnapshot
+{
+public:
+    [[nodiscard]] std::size_t getLineCount() const;
+
+    //Call the function with every line and its timestamp in order, return false if the scrollback could not be read
+    bool forEachLine(std::function<void(std::string_view line, uint64_t timestamp)> const& function) const;
+
+private:
+    std::shared_ptr<LineChunk const> g_firstChunk;
+    //Only the captured lines of the last chunk are read, the stream keeps appending to it
+    LineChunk const* g_lastChunk{nullptr};
+    std::size_t g_firstLine{0};
+    std::size_t g_hotLineCount{0};
+
+    std::vector<std::shared_ptr<ScrollbackSegment const> > g_segments;
+    std::size_t g_coldLineCount{0};
+
+    friend class TextOutputStream;
 };
 
 class GTERMINAL_API TextOutputStream : public Element
 {
 public:
-    TextOutputStream() = default;
-    ~TextOutputStream() override = default;
+    static constexpr std::size_t DefaultHotLineCount = 1024;
+    static constexpr std::size_t FilterScanBudget = 1 << 16;
+    static constexpr std::size_t FilterRegexScanBudget = 1 << 12;
+
+    enum class FilterMode : uint8_t
+    {
+        SUBSTRING,
+        REGEX
+    };
+    enum class TimestampMode : uint8_t
+    {
+        NONE,
+        ABSOLUTE,          //Local wall clock time of arrival
+        RELATIVE_PREVIOUS, //Time elapsed since the previous line
+        RELATIVE_NOW       //Age of the line, refreshed every second
+    };
+
+    //Lines are stored in chunks allocated from the resource
+    explicit TextOutputStream(std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+    ~TextOutputStream() override;
 
     void render(std::ostream& stream) const override;
 
     [[nodiscard]] inline bool haveOutputStream() const override { return true; }
+    [[nodiscard]] inline bool isScrolling() const override { return true; }
 
     void setBufferLimit(std::size_t limit);
     [[nodiscard]] std::size_t getBufferLimit() const;
 
+    //Scrollback
+    //Lines that exceed the buffer limit are spilled into memory-mapped segment files
+    //created in the provided directory instead of being dropped. A line that can't be written (full device,
+    //mapping failure) disables the file and calls _onScrollbackFailure, its lines are discarded and the stream
+    //drops its lines past the hot line count from then on.
+    bool enableScrollbackFile(std::string const& directory);
+    void disableScrollbackFile();
+    [[nodiscard]] bool isScrollbackFileEnabled() const;
+
+    [[nodiscard]] std::size_t getLineCount() const;
+    //The returned view is valid until the next call to getLine() or onInput()
+    [[nodiscard]] std::string_view getLine(std::size_t index) const;
+
+    void setScrollOffset(std::size_t offset);
+    [[nodiscard]] std::size_t getScrollOffset() const;
+
+    //Snapshot
+    //Capture the current lines without copying them, in constant time (plus one pointer per scrollback segment)
+    [[nodiscard]] OutputSnapshot takeSnapshot() const;
+
+    //Timestamp
+    //Every line is stamped on arrival with a coarse monotonic clock (milliseconds),
+    //the timestamps are only formatted for the visible lines.
+    void setTimestampMode(TimestampMode mode);
+    [[nodiscard]] TimestampMode getTimestampMode() const;
+    [[nodiscard]] uint64_t getLineTimestamp(std::size_t index) const;
+
+    //Filter
+    //Only the lines matching the filter are rendered, the scrollback is scanned incrementally on update()
+    void setFilter(std::string_view pattern, FilterMode mode=FilterMode::SUBSTRING);
+    void clearFilter();
+    [[nodiscard]] bool isFiltered() const;
+    [[nodiscard]] std::string const& getFilter() const;
+    [[nodiscard]] std::size_t getMatchCount() const;
+    [[nodiscard]] bool isFilterComplete() const;
+
     void clear();
 
     //Event
     void onInput(std::string_view str) override;
+    void onUpdate() override;
+
+    //Callback
+    CallbackHandler<> _onScrollbackFailure;
 
 private:
-    std::vector<std::string> g_textBuffer;
+    [[nodiscard]] std::size_t getVisibleRowCount() const;
+    void renderLine(std::ostream& stream, std::size_t index, uint64_t now) const;
+
+    void appendLine(std::string_view line, uint64_t timestamp);
+    void dropFirstLine();
+    [[nodiscard]] LineChunk const& findChunk(std::size_t line) const;
+
+    std::pmr::unsynchronized_pool_resource g_linePool;
+    //Hot lines are appended to chunks allocated from the upstream resource, a chunk that no snapshot
+    //references anymore is kept for reuse. Lines have absolute identifiers starting from g_firstLine.
+    std::pmr::deque<std::shared_ptr<LineChunk> > g_chunks;
+    std::shared_ptr<LineChunk> g_spareChunk;
+    std::size_t g_firstLine{0};
+    std::size_t g_lineCount{0};
+    TimestampMode g_timestampMode{TimestampMode::NONE};
+    uint64_t g_timestampSecond{0};
     std::size_t g_bufferLimit{0};
+    std::size_t g_scrollOffset{0};
+    std::unique_ptr<ScrollbackFile> g_scrollback;
+    std::unique_ptr<ScrollbackSearch> g_search;
+};
+
+/*
+ * Pane that runs a child process and shows its standard output and error.
+ * The pipes are read without blocking on update(), at most ReadBudget bytes per update so a
+ * child producing faster than the terminal can consume is blocked on its full pipe.
+ */
+class GTERMINAL_API ProcessOutput : public TextOutputStream
+{
+public:
+    static constexpr std::size_t ReadBudget = 256 * 1024;
+    static constexpr std::size_t MaxLineLength = 64 * 1024;
+    //Destroying a running process sends SIGTERM then SIGKILL after this delay
+    static constexpr std::chrono::milliseconds TerminateTimeout{2000};
+
+    explicit ProcessOutput(std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+    ~ProcessOutput() override;
+
+    [[nodiscard]] inline bool haveOutputStream() const override { return false; }
+
+    //The first argument is the program, searched in PATH
+    bool start(std::vector<std::string> const& arguments);
+    void terminate();
+
+    [[nodiscard]] bool isRunning() const;
+    [[nodiscard]] int getExitCode() const;
+
+    //Event
+    void onUpdate() override;
+
+    //Callback
+    CallbackHandler<int> _onExit;
+
+private:
+    struct Pipe
+    {
+#ifdef _WIN32
+        void* _handle{nullptr};
+#else
+        int _fd{-1};
+#endif //_WIN32
+        std::vector<char> _buffer;
+        std::size_t _used{0};
+    };
+
+    [[nodiscard]] static bool IsOpen(Pipe const& pipe);
+    static void Close(Pipe& pipe);
+    [[nodiscard]] std::size_t readPipe(Pipe& pipe, std::size_t budget, bool error);
+    void pushLine(std::string_view line, bool error);
+    void checkExit();
+
+    Pipe g_stdout;
+    Pipe g_stderr;
+    std::string g_errorLine;
+#ifdef _WIN32
+    void* g_process{nullptr};
+#else
+    int g_pid{-1};
+#endif //_WIN32
+    bool g_running{false};
+    int g_exitCode{0};
+};
+
+/*
+ * Prefix tree of words, each word holds a value.
+ * Siblings are kept sorted so the first word below a node is found by following the first children.
+ * Every node counts the words below it, a completion never scans the candidates.
+ */
+class GTERMINAL_API CompletionTrie
+{
+public:
+    using NodeIndex = uint32_t;
+    static constexpr NodeIndex Root = 0;
+    static constexpr NodeIndex InvalidNode = std::numeric_limits<NodeIndex>::max();
+    static constexpr uint32_t InvalidValue = std::numeric_limits<uint32_t>::max();
+
+    CompletionTrie();
+    ~CompletionTrie() = default;
+
+    //Return false if the word is already present or empty
+    bool insert(std::string_view word, uint32_t value=0);
+    bool erase(std::string_view word);
+    void clear();
+
+    [[nodiscard]] std::size_t getWordCount() const;
+    [[nodiscard]] uint32_t getValue(std::string_view word) const;
+
+    //Walk the tree one character at a time, InvalidNode once nothing match
+    [[nodiscard]] NodeIndex step(NodeIndex node, char c) const;
+    [[nodiscard]] NodeIndex find(std::string_view prefix, NodeIndex node=Root) const;
+
+    [[nodiscard]] std::size_t getCandidateCount(NodeIndex node) const;
+    //Append the longest common extension of the candidates, or the first candidate if there is none
+    void appendCompletion(NodeIndex node, std::string& str) const;
+
+private:
+    struct Node
+    {
+        NodeIndex _firstChild{InvalidNode};
+        NodeIndex _nextSibling{InvalidNode};
+        uint32_t _count{0};
+        uint32_t _value{InvalidValue};
+        char _char{0};
+    };
+
+    std::vector<Node> g_nodes;
+    std::vector<NodeIndex> g_freeNodes;
+};
+
+/*
+ * Commands dispatched by name from a TextInputStream.
+ * Arguments are views on the input line (quotes group words with spaces), they are only valid during the call.
+ * The first token is completed from the command names, the next ones from the completion words.
+ */
+class GTERMINAL_API CommandRegistry
+{
+public:
+    using Arguments = std::vector<std::string_view>;
+    using Handler = std::function<void(Arguments const& arguments)>;
+
+    CommandRegistry() = default;
+    ~CommandRegistry() = default;
+
+    //arguments[0] is the command name
+    bool addCommand(std::string_view name, Handler handler);
+    bool removeCommand(std::string_view name);
+    [[nodiscard]] bool haveCommand(std::string_view name) const;
+
+    bool addCompletion(std::string_view word);
+    bool removeCompletion(std::string_view word);
+
+    //Return false if the command is unknown
+    bool execute(std::string_view line);
+
+    [[nodiscard]] CompletionTrie const& getCommands() const;
+    [[nodiscard]] CompletionTrie const& getCompletions() const;
+
+    static void Tokenize(std::string_view line, Arguments& arguments);
+
+private:
+    CompletionTrie g_commands;
+    CompletionTrie g_completions;
+    std::vector<Handler> g_handlers;
+    std::vector<uint32_t> g_freeHandlers;
+    Arguments g_arguments;
 };
 
 class GTERMINAL_API TextInputStream : public Element
@@ -206,6 +697,22 @@ public:
     void render(std::ostream& stream) const override;
 
     [[nodiscard]] inline bool haveInputStream() const override { return true; }
+    [[nodiscard]] inline uint16_t getPreferredHeight() const override { return 1; }
+
+    //Ctrl+F toggles the filter prompt, typed text is applied live to the target (prefix with '/' for a regex)
+    void setFilterTarget(TextOutputStream* target);
+    [[nodiscard]] TextOutputStream* getFilterTarget() const;
+
+    //Entered lines are executed by the registry (_onInput is still called), Tab accepts the suggestion
+    void setCommandRegistry(CommandRegistry* registry);
+    [[nodiscard]] CommandRegistry* getCommandRegistry() const;
+
+    //The next entered line is moved to line and the continuation scheduled, the line is not executed
+    //nor given to _onInput. Waiters are served in order, one line each.
+    void awaitLine(Continuation continuation, std::string* line);
+#ifdef GTERMINAL_COROUTINES
+    [[nodiscard]] LineAwaitable readLine();
+#endif //GTERMINAL_COROUTINES
 
     //Event
     void onKeyInput(KeyEvent const& keyEvent) override;
@@ -214,7 +721,24 @@ public:
     CallbackHandler<std::string_view> _onInput;
 
 private:
+    void applyFilter();
+    void resetCompletion();
+    void pushCompletion(char c);
+    [[nodiscard]] CompletionTrie const* getCompletionTrie() const;
+
     std::string g_inputBuffer;
+    std::string g_filterBuffer;
+    TextOutputStream* g_filterTarget{nullptr};
+    bool g_filtering{false};
+
+    //Trie nodes matching every character of the last token, the view follows the typed text
+    CommandRegistry* g_registry{nullptr};
+    std::vector<CompletionTrie::NodeIndex> g_completionPath;
+    mutable std::string g_suggestion;
+    bool g_completingCommand{true};
+
+    std::mutex g_lineWaitersMutex;
+    std::deque<std::pair<Continuation, std::string*> > g_lineWaiters;
 };
 
 class GTERMINAL_API Banner : public Element
@@ -226,6 +750,8 @@ public:
 
     void render(std::ostream& stream) const override;
 
+    [[nodiscard]] inline uint16_t getPreferredHeight() const override { return 1; }
+
     void setBanner(std::string_view banner);
     [[nodiscard]] std::string const& getBanner() const;
 
@@ -237,18 +763,334 @@ private:
     bool g_centered{true};
 };
 
+/*
+ * The following elements are driven by public atomics that producers can update at any rate
+ * without locking or invalidating the terminal. The values are sampled on update() and the
+ * element is only invalidated when its visible representation change.
+ */
+class GTERMINAL_API ProgressBar : public Element
+{
+public:
+    ProgressBar() = default;
+    explicit ProgressBar(uint64_t total, std::string_view label={});
+    ~ProgressBar() override = default;
+
+    void render(std::ostream& stream) const override;
+
+    [[nodiscard]] inline uint16_t getPreferredHeight() const override { return 1; }
+
+    void setLabel(std::string_view label);
+    [[nodiscard]] std::string const& getLabel() const;
+
+    //Event
+    void onUpdate() override;
+
+    std::atomic<uint64_t> _value{0};
+    std::atomic<uint64_t> _total{0};
+
+private:
+    [[nodiscard]] std::size_t getBarWidth() const;
+
+    std::string g_label;
+    uint64_t g_value{0};
+    uint64_t g_total{0};
+};
+
+class GTERMINAL_API Gauge : public Element
+{
+public:
+    Gauge() = default;
+    Gauge(double min, double max, std::string_view label={});
+    ~Gauge() override = default;
+
+    void render(std::ostream& stream) const override;
+
+    [[nodiscard]] inline uint16_t getPreferredHeight() const override { return 1; }
+
+    void setLabel(std::string_view label);
+    [[nodiscard]] std::string const& getLabel() const;
+
+    void setRange(double min, double max);
+    [[nodiscard]] double getMin() const;
+    [[nodiscard]] double getMax() const;
+
+    void setPrecision(int precision);
+    [[nodiscard]] int getPrecision() const;
+
+    //Event
+    void onUpdate() override;
+
+    std::atomic<double> _value{0.0};
+
+private:
+    [[nodiscard]] std::size_t getBarWidth() const;
+
+    std::string g_label;
+    double g_min{0.0};
+    double g_max{1.0};
+    int g_precision{1};
+    double g_value{0.0};
+    std::string g_text;
+};
+
+class GTERMINAL_API Sparkline : public Element
+{
+public:
+    Sparkline() = default;
+    explicit Sparkline(std::string_view label);
+    ~Sparkline() override = default;
+
+    void render(std::ostream& stream) const override;
+
+    [[nodiscard]] inline uint16_t getPreferredHeight() const override { return 1; }
+
+    void setLabel(std::string_view label);
+    [[nodiscard]] std::string const& getLabel() const;
+
+    //When min == max, the range is computed from the visible samples
+    void setRange(double min, double max);
+    [[nodiscard]] double getMin() const;
+    [[nodiscard]] double getMax() const;
+
+    void setSamplePeriod(std::chrono::milliseconds period);
+    [[nodiscard]] std::chrono::milliseconds getSamplePeriod() const;
+
+    //Event
+    void onUpdate() override;
+
+    std::atomic<double> _value{0.0};
+
+private:
+    [[nodiscard]] std::size_t getPointCount() const;
+    void computeLevels(std::string& levels) const;
+
+    std::string g_label;
+    double g_min{0.0};
+    double g_max{0.0};
+    std::chrono::milliseconds g_samplePeriod{100};
+    std::chrono::steady_clock::time_point g_lastSample{};
+    std::vector<double> g_samples;
+    std::string g_levels;
+    std::string g_nextLevels;
+};
+
+class GTERMINAL_API TableBatch
+{
+public:
+    TableBatch() = default;
+    ~TableBatch() = default;
+
+    void setInteger(uint64_t key, std::size_t column, int64_t value);
+    void setFloat(uint64_t key, std::size_t column, double value);
+    void setText(uint64_t key, std::size_t column, std::string_view value);
+    void removeRow(uint64_t key);
+
+    void clear();
+    [[nodiscard]] bool isEmpty() const;
+
+private:
+    enum class Operation : uint8_t
+    {
+        INTEGER,
+        FLOAT,
+        TEXT,
+        REMOVE
+    };
+    struct Entry
+    {
+        uint64_t _key;
+        uint32_t _column;
+        Operation _operation;
+        union
+        {
+            int64_t _integer;
+            double _float;
+            struct
+            {
+                uint32_t _offset;
+                uint32_t _size;
+            } _text;
+        };
+    };
+
+    friend class Table;
+    std::vector<Entry> g_entries;
+    std::string g_texts;
+};
+
+/*
+ * Table with a columnar backing store, rows are identified by a key and updated by batch.
+ * Cells are only formatted when they are visible and changed since their last formatting,
+ * and updates outside the visible window do not invalidate the element.
+ * apply() can be called from any thread.
+ */
+class GTERMINAL_API Table : public Element
+{
+public:
+    enum class ColumnType : uint8_t
+    {
+        INTEGER,
+        FLOAT,
+        TEXT
+    };
+
+    Table() = default;
+    ~Table() override = default;
+
+    void render(std::ostream& stream) const override;
+
+    std::size_t addColumn(std::string_view name, ColumnType type, uint16_t width, int precision=2);
+    [[nodiscard]] std::size_t getColumnCount() const;
+    [[nodiscard]] std::size_t getRowCount() const;
+
+    void apply(TableBatch const& batch);
+    void clear();
+
+    //Rows are sorted by key when no sort column is set
+    void sortBy(std::size_t column, bool ascending=true);
+    void sortByKey();
+
+    void setScrollRow(std::size_t row);
+    [[nodiscard]] std::size_t getScrollRow() const;
+    bool scrollToKey(uint64_t key);
+    void setScrollColumn(std::size_t column);
+    [[nodiscard]] std::size_t getScrollColumn() const;
+
+    //Event
+    void onUpdate() override;
+
+private:
+    static constexpr std::size_t NoSortColumn = static_cast<std::size_t>(-1);
+    //Rows of the display order per block, a block is split when it grows over twice that
+    //and merged into a neighbour when it shrinks under half of it
+    static constexpr std::size_t OrderBlockSize = 256;
+
+    struct Column
+    {
+        std::string _name;
+        ColumnType _type;
+        uint16_t _width;
+        int _precision;
+        std::vector<int64_t> _integers;
+        std::vector<double> _floats;
+        std::vector<std::string> _texts;
+        mutable std::vector<std::string> _encoded;
+        mutable std::vector<uint8_t> _dirty;
+    };
+
+    struct OrderBlock
+    {
+        std::vector<uint32_t> _slots;
+    };
+
+    [[nodiscard]] uint32_t getOrCreateRow(uint64_t key);
+    [[nodiscard]] bool removeRowSlot(uint32_t slot);
+    void rebuildOrder();
+    void insertOrdered(uint32_t slot);
+    void eraseOrdered(uint32_t slot);
+    [[nodiscard]] std::size_t getPosition(uint32_t slot) const;
+    [[nodiscard]] bool isBeforeWindowEnd(uint32_t slot) const;
+    void refreshVisible();
+    [[nodiscard]] bool isVisible(uint32_t slot) const;
+    [[nodiscard]] bool isLess(uint32_t a, uint32_t b) const;
+    void encodeCell(Column const& column, uint32_t slot) const;
+
+    mutable std::mutex g_mutex;
+    std::vector<Column> g_columns;
+    std::vector<uint64_t> g_keys;
+    std::unordered_map<uint64_t, uint32_t> g_slots;
+
+    //Display order, a slot without block is waiting for its position (new row or sort value changed)
+    std::vector<std::unique_ptr<OrderBlock> > g_blocks;
+    std::vector<OrderBlock*> g_slotBlocks;
+    std::vector<uint8_t> g_changed;
+    std::vector<uint32_t> g_changedSlots;
+    bool g_rebuildOrder{false};
+
+    //Rows of the window as of the last update, only their changes invalidate the table
+    std::vector<uint8_t> g_visible;
+    std::vector<uint32_t> g_visibleSlots;
+    std::size_t g_visibleRows{0};
+
+    std::size_t g_sortColumn{NoSortColumn};
+    bool g_ascending{true};
+    std::size_t g_scrollRow{0};
+    std::size_t g_scrollColumn{0};
+
+    //Render buffers, they keep their capacity between frames
+    mutable std::vector<std::pair<std::size_t, std::size_t> > g_renderColumns;
+    mutable std::string g_renderLine;
+};
+
+/*
+ * Destination of a named channel, a channel without element is routed to the default output stream.
+ */
+struct ChannelRoute
+{
+    Element* _element{nullptr};
+    //Identifier of the channel in the running recording, 0 until it is first recorded
+    uint64_t _recordId{0};
+};
+
+/*
+ * Handle on a named output channel, the routing is resolved once by Terminal::channel()
+ * so outputting through a handle cost the same as Terminal::output().
+ * A channel without element is routed to the default output stream.
+ */
+class OutputChannel
+{
+public:
+    OutputChannel() = default;
+
+    template<class ...TArgs>
+    void output(char const* format, TArgs&&... args);
+    template<class ...TArgs>
+    void output(std::string const& format, TArgs&&... args);
+    //The text is not a format and can contain any byte
+    void outputText(std::string_view str);
+
+    [[nodiscard]] inline bool isValid() const { return this->g_terminal != nullptr; }
+    [[nodiscard]] inline Terminal* getTerminal() const { return this->g_terminal; }
+
+private:
+    inline OutputChannel(Terminal* terminal, ChannelRoute* route) :
+            g_terminal(terminal),
+            g_route(route)
+    {}
+
+    friend class Terminal;
+    Terminal* g_terminal{nullptr};
+    ChannelRoute* g_route{nullptr};
+};
+
 class GTERMINAL_API Terminal
 {
 public:
-    Terminal();
+    //The resource is the upstream of the frame arena and of the elements created by addElement() that take one
+    //(the output streams). The element list, the channels, the frame buffer and the other elements use the global
+    //heap, they only allocate when they are configured or grow, not per line or per frame.
+    explicit Terminal(std::pmr::memory_resource* resource=std::pmr::get_default_resource());
     ~Terminal();
 
+    //Initialize on the standard input and output
     [[nodiscard]] bool init();
+    //Initialize on any terminal device (tty, pty slave), the descriptors are not owned by the terminal
+    //and must stay open while it is alive. The raw mode is restored on destruction.
+#ifdef _WIN32
+    [[nodiscard]] bool init(void* inputHandle, void* outputHandle);
+#else
+    [[nodiscard]] bool init(int inputDescriptor, int outputDescriptor);
+#endif //_WIN32
+    [[nodiscard]] bool isInitialized() const;
+
+    //std::cout is process wide, only one terminal at a time can redirect it
     bool redirectStandardOutputStream();
     void restoreStandardOutputStream();
 
     //Control
     [[nodiscard]] BufferSize getTerminalBufferSize() const;
+    //Overridden by the real size on update() when the terminal is initialized
+    void setTerminalBufferSize(BufferSize size);
 
     void clearTerminalBuffer();
     void saveCursorPosition();
@@ -256,21 +1098,113 @@ public:
 
     //Output stream
     template<class ...TArgs>
+    void output(char const* format, TArgs&&... args);
+    template<class ...TArgs>
     void output(std::string const& format, TArgs&&... args);
+    //The text is not a format and can contain any byte
+    void outputText(std::string_view str);
+
+    //Memory
+    [[nodiscard]] std::pmr::memory_resource* getMemoryResource() const;
+    //Monotonic arena for temporary render data, released after every frame (only valid during render())
+    [[nodiscard]] std::pmr::memory_resource* getFrameResource() const;
+
+    //Channel
+    [[nodiscard]] OutputChannel channel(std::string const& name);
+    void setChannelOutput(std::string const& name, Element* element);
+    [[nodiscard]] Element* getChannelOutput(std::string const& name) const;
 
     //Element
+    //The element is placed in a new region at the end of the root region, see Region::setElement() to move it
     Element* addElement(std::unique_ptr<Element>&& element);
+    //An element taking a memory resource as its last argument is given the one of the terminal when it is omitted
     template<class TElement, class ...TArgs>
     TElement* addElement(TArgs&&... args);
+    bool removeElement(Element const* element);
+
+    //Layout
+    [[nodiscard]] Region* getRootRegion();
+    //Floating region with an absolute rectangle, composed over the root region
+    Region* addOverlay(Rect rect, int16_t zOrder=1);
+    bool removeOverlay(Region const* region);
 
     void update();
+    void pushKeyEvent(KeyEvent const& keyEvent);
     void render() const;
+
+    //Pacing
+    //While the device output queue takes longer than the latency to drain (slow links), frames are held back
+    //and only the input rows are written, the next frame carries the latest state. 0 disables the pacing.
+    void setMaxOutputLatency(std::chrono::milliseconds latency);
+    [[nodiscard]] std::chrono::milliseconds getMaxOutputLatency() const;
+    //Estimated drain rate of the device in bytes per second, 0 until the link was seen congested
+    [[nodiscard]] double getOutputDrainRate() const;
+    [[nodiscard]] std::size_t getHeldFrameCount() const;
+
+    //Continuation
+    //Scheduled continuations are resumed in a batch at the end of update(), outside of the terminal lock
+    void schedule(Continuation continuation) const;
+    //The next pressed key is consumed by the first waiter instead of being given to the input elements
+    void awaitKey(Continuation continuation, KeyEvent* keyEvent);
+    //Every waiter is scheduled on the next call to render()
+    void awaitFrame(Continuation continuation);
+#ifdef GTERMINAL_COROUTINES
+    [[nodiscard]] KeyAwaitable nextKey();
+    [[nodiscard]] FrameAwaitable nextFrame();
+#endif //GTERMINAL_COROUTINES
+
     void invalidate() const;
+    void invalidateElement(Element const* element) const;
+    void invalidateLayout() const;
+
+    //Recording
+    //Capture the ingested text, key and resize events and the rendered frames, see SessionReplay
+    bool startRecording(std::string const& path);
+    void stopRecording();
+    [[nodiscard]] bool isRecording() const;
+    //True while a SessionReplay gives a recorded key to the input elements, they update their state
+    //but run no handler : the recording already holds the output they produced
+    [[nodiscard]] bool isReplayingInput() const;
 
-    void setRowOffset(uint16_t offset);
-    [[nodiscard]] uint16_t getRowOffset() const;
+    //Attach
+    //Viewers connecting to the Unix domain socket receive a snapshot then every rendered frame,
+    //a viewer that cannot keep up is resynchronized with a new snapshot (POSIX only)
+    bool startAttachServer(std::string const& path);
+    void stopAttachServer();
+    [[nodiscard]] bool isAttachServerRunning() const;
+    [[nodiscard]] std::size_t getViewerCount() const;
+
+    //Append a frame that repaint the whole screen from the last rendered state
+    void composeSnapshot(std::string& frame) const;
+
+    //Snapshot
+    enum class SnapshotFormat : uint8_t
+    {
+        PLAIN, //The screen then the lines of every output stream, escape sequences are removed
+        ANSI   //The lines with their SGR sequences then a frame that redraws the screen, cat the file to see it
+    };
+    //Capture the screen and the lines of every output stream then write them to the file from a background thread,
+    //the terminal is only locked for the capture. The continuation is scheduled once the file is written, success
+    //is set before. Return false if an export is already running.
+    bool exportSnapshot(std::string const& path, SnapshotFormat format=SnapshotFormat::PLAIN,
+                        Continuation done={nullptr, nullptr}, bool* success=nullptr);
+    [[nodiscard]] bool isExportingSnapshot() const;
 
 private:
+    void pollInput();
+    [[nodiscard]] csi::Cursor getCursorPosition() const;
+    //Bytes waiting in the device output queue, -1 when the device does not report it
+    [[nodiscard]] int64_t getOutputQueueSize() const;
+    void recordOutput(ChannelRoute* route, std::string_view str);
+    void outputTextTo(ChannelRoute* route, std::string_view str);
+    void replayKeyEvent(KeyEvent const& keyEvent);
+
+    template<class ...TArgs>
+    void outputTo(ChannelRoute* route, char const* format, TArgs&&... args);
+
+    void computeLayout() const;
+    void renderElement(Element const& element, std::pmr::string& content, std::pmr::vector<std::pmr::string>& rows) const;
+
     using ElementList = std::list<std::unique_ptr<Element> >;
     union Handle
     {
@@ -279,6 +1213,7 @@ private:
     };
 
     mutable bool g_invalidRender{true};
+    bool g_initialized{false};
 
     Handle g_internalInputHandle{nullptr};
     Handle g_internalOutputHandle{nullptr};
@@ -286,17 +1221,233 @@ private:
     ElementList g_elements;
     ElementList::const_iterator g_defaultOutputStream;
 
+    //Mapped values are never moved by the container, handles keep a pointer to them
+    std::unordered_map<std::string, ChannelRoute> g_channels;
+
+    std::unique_ptr<Region> g_rootRegion;
+    std::vector<std::pair<std::unique_ptr<Region>, Rect> > g_overlays;
+    mutable std::vector<std::pair<int16_t, Element*> > g_paintOrder;
+    mutable bool g_invalidLayout{true};
+
+    std::pmr::memory_resource* g_resource;
+    std::unique_ptr<FrameArena> g_frameArena;
+    mutable std::ostream g_renderStream{nullptr};
+    std::string g_formatBuffer;
+    mutable std::string g_frame;
+    //Where the last frame left the cursor, relative moves are only emitted from a known position
+    mutable csi::Cursor g_cursor;
+
+    std::unique_ptr<OutputPacer> g_pacer;
+    //Rectangles painted by input only frames, the next full frame repaints what they may have covered
+    mutable std::vector<Rect> g_deferredRepaint;
+
     BufferSize g_bufferSize{0,0};
 
-    uint16_t g_rowOffset{0};
+    std::unique_ptr<RawMode> g_rawMode;
 
     std::streambuf* g_oldStdoutBuffer{nullptr};
     std::unique_ptr<std::streambuf> g_newStdoutBuffer{nullptr};
+    std::unique_ptr<std::streambuf> g_outputBuffer{nullptr};
     mutable std::ostream g_internalOutputStream{nullptr};
 
+    std::unique_ptr<SessionRecorder> g_recorder;
+    bool g_replayingInput{false};
+    std::unique_ptr<AttachServer> g_attachServer;
+    std::unique_ptr<SnapshotExport> g_snapshotExport;
+
+    mutable std::vector<Continuation> g_scheduled;
+    std::vector<Continuation> g_spareScheduled;
+    std::deque<std::pair<Continuation, KeyEvent*> > g_keyWaiters;
+    mutable std::vector<Continuation> g_frameWaiters;
+
+    mutable std::recursive_mutex g_mutex;
+
+    friend class Region;
+    friend class OutputChannel;
+    friend class EventLoop;
+    friend class SessionReplay;
+};
+
+/*
+ * Drive several terminals from one thread : wait for input on all of them at once,
+ * update every terminal and render them at the frame interval.
+ */
+class GTERMINAL_API EventLoop
+{
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(EventLoop const&) = delete;
+    EventLoop& operator=(EventLoop const&) = delete;
+
+    //The terminal must be initialized and outlive its registration
+    bool addTerminal(Terminal* terminal);
+    bool removeTerminal(Terminal const* terminal);
+    [[nodiscard]] std::size_t getTerminalCount() const;
+
+    void setFrameInterval(std::chrono::milliseconds interval);
+    [[nodiscard]] std::chrono::milliseconds getFrameInterval() const;
+
+    //Wait for input until the next frame is due, update every terminal then render them if the frame is due
+    void runOnce();
+    //Run until stop() is called, from any thread or from a callback
+    void run();
+    void stop();
+    [[nodiscard]] bool isRunning() const;
+
+private:
+    struct Entry
+    {
+        Terminal* _terminal;
+        //The device was closed, it is still updated and rendered but no longer waited on
+        bool _hangup;
+    };
+    std::vector<Entry> g_terminals;
+#ifndef _WIN32
+    //Refilled by every runOnce(), it only grows when a terminal is added
+    std::vector<pollfd> g_descriptors;
+#endif //_WIN32
+
+    std::chrono::milliseconds g_frameInterval{20};
+    std::chrono::steady_clock::time_point g_nextFrame{};
+    std::atomic_bool g_running{false};
+
     mutable std::recursive_mutex g_mutex;
 };
 
+/*
+ * Re-drive a terminal from a recording made with Terminal::startRecording().
+ * The recording is a header followed by events, each event is a type byte, the time elapsed
+ * since the previous event in microseconds (LEB128) and a payload :
+ * CHANNEL id name, OUTPUT channelId text, KEY keyEvent, RESIZE width height, FRAME bytes.
+ * Integers are LEB128 encoded and strings are prefixed by their size.
+ * Recorded frames are not written back, the terminal is updated and rendered at their place instead.
+ * Recorded keys only update the input elements, the output of their handlers is replayed from the OUTPUT events.
+ */
+class GTERMINAL_API SessionReplay
+{
+public:
+    enum class EventType : uint8_t
+    {
+        CHANNEL = 1,
+        OUTPUT,
+        KEY,
+        RESIZE,
+        FRAME
+    };
+    static constexpr char Magic[4] = {'G', 'T', 'R', 'C'};
+    static constexpr uint8_t Version = 1;
+    //Channels are numbered from 1 in the order they are first recorded, a larger identifier is malformed
+    static constexpr uint64_t MaxChannelId = 1 << 16;
+
+    SessionReplay() = default;
+    ~SessionReplay();
+
+    SessionReplay(SessionReplay const&) = delete;
+    SessionReplay& operator=(SessionReplay const&) = delete;
+
+    bool open(std::string const& path);
+    void close();
+
+    //1 replay at the recorded pace, N times faster, 0 as fast as possible
+    void setSpeed(double speed);
+    [[nodiscard]] double getSpeed() const;
+
+    //Replay the next event, return false at the end of the recording or on a malformed event
+    bool step(Terminal& terminal);
+    void play(Terminal& terminal);
+
+    [[nodiscard]] std::size_t getEventCount() const;
+    [[nodiscard]] std::size_t getFrameCount() const;
+    [[nodiscard]] std::chrono::microseconds getTimestamp() const;
+    //True when the replay stopped on a truncated or corrupted event
+    [[nodiscard]] bool isMalformed() const;
+
+private:
+    [[nodiscard]] bool replayEvent(Terminal& terminal, EventType type);
+    [[nodiscard]] bool readVarint(uint64_t& value);
+    //Sizes are checked against the remaining bytes before anything is allocated or skipped
+    [[nodiscard]] bool readString(std::string& str);
+    [[nodiscard]] bool skip(uint64_t size);
+    [[nodiscard]] uint64_t getRemainingSize() const;
+
+    std::FILE* g_file{nullptr};
+    uint64_t g_fileSize{0};
+    bool g_malformed{false};
+    std::vector<OutputChannel> g_channels;
+    std::string g_buffer;
+    double g_speed{1.0};
+    std::chrono::microseconds g_timestamp{0};
+    std::chrono::steady_clock::time_point g_start{};
+    std::size_t g_eventCount{0};
+    std::size_t g_frameCount{0};
+};
+
+#ifdef GTERMINAL_COROUTINES
+/*
+ * C++20 coroutine awaitables, a suspended coroutine is resumed by Terminal::update().
+ * It must stay alive until then : the frame of a Task destroys itself when the coroutine ends.
+ */
+struct Task
+{
+    struct promise_type
+    {
+        [[nodiscard]] inline Task get_return_object() const noexcept { return {}; }
+        [[nodiscard]] inline std::suspend_never initial_suspend() const noexcept { return {}; }
+        [[nodiscard]] inline std::suspend_never final_suspend() const noexcept { return {}; }
+        inline void return_void() const noexcept {}
+        [[noreturn]] inline void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+inline void ResumeCoroutine(void* address)
+{
+    std::coroutine_handle<>::from_address(address).resume();
+}
+
+class LineAwaitable
+{
+public:
+    inline explicit LineAwaitable(TextInputStream* input) : g_input(input) {}
+
+    [[nodiscard]] inline bool await_ready() const noexcept { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle);
+    [[nodiscard]] inline std::string await_resume() { return std::move(this->g_line); }
+
+private:
+    TextInputStream* g_input;
+    std::string g_line;
+};
+
+class KeyAwaitable
+{
+public:
+    inline explicit KeyAwaitable(Terminal* terminal) : g_terminal(terminal) {}
+
+    [[nodiscard]] inline bool await_ready() const noexcept { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle);
+    [[nodiscard]] inline KeyEvent await_resume() const { return this->g_keyEvent; }
+
+private:
+    Terminal* g_terminal;
+    KeyEvent g_keyEvent{};
+};
+
+class FrameAwaitable
+{
+public:
+    inline explicit FrameAwaitable(Terminal* terminal) : g_terminal(terminal) {}
+
+    [[nodiscard]] inline bool await_ready() const noexcept { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle);
+    inline void await_resume() const noexcept {}
+
+private:
+    Terminal* g_terminal;
+};
+#endif //GTERMINAL_COROUTINES
+
 } //namespace gt
 
 #include "gTerminal.inl"
@@ -24,38 +24,137 @@
 namespace gt
 {
 
+inline void Element::invalidate() const
+{
+    if (this->g_terminal != nullptr)
+    {
+        this->g_terminal->invalidateElement(this);
+    }
+}
+
+template<class ...TArgs>
+void OutputChannel::output(char const* format, TArgs&&... args)
+{
+    if (this->g_terminal != nullptr)
+    {
+        this->g_terminal->outputTo(this->g_route, format, std::forward<TArgs>(args)...);
+    }
+}
+template<class ...TArgs>
+void OutputChannel::output(std::string const& format, TArgs&&... args)
+{
+    this->output(format.c_str(), std::forward<TArgs>(args)...);
+}
+inline void OutputChannel::outputText(std::string_view str)
+{
+    if (this->g_terminal != nullptr)
+    {
+        this->g_terminal->outputTextTo(this->g_route, str);
+    }
+}
+
+template<class ...TArgs>
+void Terminal::output(char const* format, TArgs&&... args)
+{
+    this->outputTo(nullptr, format, std::forward<TArgs>(args)...);
+}
 template<class ...TArgs>
 void Terminal::output(std::string const& format, TArgs&&... args)
 {
-    if (format.empty())
+    this->outputTo(nullptr, format.c_str(), std::forward<TArgs>(args)...);
+}
+
+template<class ...TArgs>
+void Terminal::outputTo(ChannelRoute* route, char const* format, TArgs&&... args)
+{
+    if (format == nullptr || format[0] == '\0')
     {
         return;
     }
 
     std::lock_guard<std::recursive_mutex> const lock(this->g_mutex);
 
-    if (this->g_defaultOutputStream == this->g_elements.end())
+    Element* element = route == nullptr ? nullptr : route->_element;
+    if (element == nullptr)
     {
-        return;
+        if (this->g_defaultOutputStream == this->g_elements.end())
+        {
+            return;
+        }
+        element = this->g_defaultOutputStream->get();
     }
 
-    auto size = std::snprintf(nullptr, 0, format.c_str(), std::forward<TArgs>(args)...);
+    //The format buffer is taken during the call so a reentrant output do not overwrite it,
+    //its capacity is kept between the calls
+    std::string str;
+    str.swap(this->g_formatBuffer);
+    str.resize(str.capacity());
 
-    if (size == 0)
+    auto size = std::snprintf(str.data(), str.size()+1, format, std::forward<TArgs>(args)...);
+    if (size <= 0)
     {
+        str.clear();
+        str.swap(this->g_formatBuffer);
         return;
     }
+    if (static_cast<std::size_t>(size) > str.size())
+    {
+        str.resize(static_cast<std::size_t>(size));
+        std::snprintf(str.data(), str.size()+1, format, std::forward<TArgs>(args)...);
+    }
+    str.resize(static_cast<std::size_t>(size));
+
+    if (this->g_recorder != nullptr)
+    {
+        this->recordOutput(route, str);
+    }
 
-    std::string str(size+1, '\0');
-    std::snprintf(str.data(), str.size(), format.c_str(), std::forward<TArgs>(args)...);
+    element->onInput(str);
 
-    this->g_defaultOutputStream->get()->onInput(str);
+    str.clear();
+    str.swap(this->g_formatBuffer);
 }
 
 template<class TElement, class ...TArgs>
 TElement* Terminal::addElement(TArgs&&... args)
 {
-    return static_cast<TElement*>(this->addElement(std::make_unique<TElement>(std::forward<TArgs>(args)...)));
+    if constexpr (std::is_constructible_v<TElement, TArgs&&..., std::pmr::memory_resource*>)
+    {
+        return static_cast<TElement*>(this->addElement(std::make_unique<TElement>(std::forward<TArgs>(args)...,
+                                                                                  this->getMemoryResource())));
+    }
+    else
+    {
+        return static_cast<TElement*>(this->addElement(std::make_unique<TElement>(std::forward<TArgs>(args)...)));
+    }
+}
+
+#ifdef GTERMINAL_COROUTINES
+inline LineAwaitable TextInputStream::readLine()
+{
+    return LineAwaitable{this};
+}
+inline KeyAwaitable Terminal::nextKey()
+{
+    return KeyAwaitable{this};
+}
+inline FrameAwaitable Terminal::nextFrame()
+{
+    return FrameAwaitable{this};
+}
+
+inline void LineAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+    this->g_input->awaitLine({&ResumeCoroutine, handle.address()}, &this->g_line);
+}
+inline void KeyAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+    this->g_terminal->awaitKey({&ResumeCoroutine, handle.address()}, &this->g_keyEvent);
+}
+inline void FrameAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+    this->g_terminal->awaitFrame({&ResumeCoroutine, handle.address()});
 }
+#endif //GTERMINAL_COROUTINES
 
-} //namespace gt
\ No newline at end of file
+} //namespace gt
@@ -0,0 +1,45 @@
+#include "gTerminal.hpp"
+#include <iostream>
+#include <cstdlib>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <recording> [speed]" << std::endl;
+        return 1;
+    }
+
+    gt::Terminal terminal;
+
+    //Channels without an output of their own fall back to the main output
+    auto* mainOutput = terminal.addElement<gt::TextOutputStream>();
+    mainOutput->setBufferLimit(1000);
+    terminal.getRootRegion()->addRegion()->setElement(mainOutput);
+    terminal.getRootRegion()->addRegion(1)->setElement(terminal.addElement<gt::TextInputStream>());
+
+    gt::SessionReplay replay;
+    if (!replay.open(argv[1]))
+    {
+        std::cerr << "Failed to open recording " << argv[1] << std::endl;
+        return 1;
+    }
+    if (argc > 2)
+    {
+        replay.setSpeed(std::strtod(argv[2], nullptr));
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    replay.play(terminal);
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    std::cout << std::flush;
+    std::cerr << "\n" << replay.getEventCount() << " events, " << replay.getFrameCount() << " frames, recorded "
+              << replay.getTimestamp().count() / 1000 << " ms, replayed " << elapsed.count() / 1000 << " ms" << std::endl;
+    if (replay.isMalformed())
+    {
+        std::cerr << "The recording is truncated or corrupted after the last replayed event" << std::endl;
+        return 1;
+    }
+    return 0;
+}
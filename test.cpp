@@ -2,21 +2,47 @@
 #include <iostream>
 #include <thread>
 
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif //_WIN32
+
 volatile bool gRunning = true;
+gt::ProgressBar* gProgress = nullptr;
 
 void threadTest(gt::Terminal* terminal)
 {
     unsigned int count = 0;
     auto id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    auto channel = terminal->channel("threads");
 
     while (gRunning)
     {
         std::cout << "std::cout > text from standard output\n";
-        terminal->output("Thread (%u) test %u\n", id, count++);
+        channel.output("Thread (%u) test %u\n", id, count++);
+        gProgress->_value.fetch_add(1, std::memory_order_relaxed);
         std::this_thread::sleep_for(std::chrono::milliseconds(800));
     }
 }
 
+#ifdef GTERMINAL_COROUTINES
+gt::Task greet(gt::Terminal& terminal, gt::TextInputStream& input)
+{
+    terminal.output("What is your name ?\n");
+    auto const name = co_await input.readLine();
+
+    terminal.output("Hello %s ! Press any key\n", name.c_str());
+    auto const key = co_await terminal.nextKey();
+
+    terminal.output("You pressed '%c', see you in 100 frames\n", key._asciiChar);
+    for (int i=0; i<100; ++i)
+    {
+        co_await terminal.nextFrame();
+    }
+    terminal.output("Bye %s\n", name.c_str());
+}
+#endif //GTERMINAL_COROUTINES
+
 int main(int argc, char** argv)
 {
     gt::Terminal terminal;
@@ -33,17 +59,124 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    terminal.addElement<gt::TextOutputStream>()->setBufferLimit(20);
-    terminal.addElement<gt::TextInputStream>()->_onInput.add([](std::string_view str)
+    //Record the session when a path is given, replay it with the replay tool
+    if (argc > 1 && !terminal.startRecording(argv[1]))
+    {
+        std::cout << "Failed to record the session to " << argv[1] << std::endl;
+        return 1;
+    }
+
+    auto* header = terminal.getRootRegion()->addRegion(1);
+    auto* body = terminal.getRootRegion()->addRegion();
+    body->setDirection(gt::Region::Direction::COLUMNS);
+
+    auto* mainOutput = terminal.addElement<gt::TextOutputStream>();
+    mainOutput->setBufferLimit(20);
+    body->addRegion()->setElement(mainOutput);
+
+    auto* threadOutput = terminal.addElement<gt::TextOutputStream>();
+    threadOutput->setBufferLimit(100);
+    threadOutput->setTimestampMode(gt::TextOutputStream::TimestampMode::RELATIVE_PREVIOUS);
+    body->addRegion()->setElement(threadOutput);
+    terminal.setChannelOutput("threads", threadOutput);
+
+    gt::EventLoop loop;
+    loop.addTerminal(&terminal);
+
+    gt::CommandRegistry commands;
+    commands.addCommand("exit", [&](gt::CommandRegistry::Arguments const&){ gRunning = false; loop.stop(); });
+    commands.addCommand("quit", [&](gt::CommandRegistry::Arguments const&){ gRunning = false; loop.stop(); });
+    commands.addCommand("clear", [&](gt::CommandRegistry::Arguments const&){ mainOutput->clear(); });
+    commands.addCommand("echo", [&](gt::CommandRegistry::Arguments const& arguments)
+    {
+        for (std::size_t i=1; i<arguments.size(); ++i)
+        {
+            terminal.output("%.*s\n", static_cast<int>(arguments[i].size()), arguments[i].data());
+        }
+    });
+    commands.addCommand("attach", [&](gt::CommandRegistry::Arguments const& arguments)
+    {
+        //Watch with : socat -u UNIX-CONNECT:<path> STDOUT
+        if (arguments.size() == 2 && terminal.startAttachServer(std::string{arguments[1]}))
+        {
+            terminal.output("Attach server listening on %s\n", std::string{arguments[1]}.c_str());
+        }
+    });
+    //Export the screen and the output streams without blocking, "snapshot <path> [ansi]"
+    struct SnapshotState
+    {
+        gt::Terminal* _terminal;
+        std::string _path;
+        bool _success;
+    } snapshot{&terminal, {}, false};
+    commands.addCommand("snapshot", [&](gt::CommandRegistry::Arguments const& arguments)
     {
-        if (str == "exit" || str == "quit")
+        if (arguments.size() < 2)
+        {
+            return;
+        }
+        auto const format = arguments.size() > 2 && arguments[2] == "ansi" ?
+                gt::Terminal::SnapshotFormat::ANSI : gt::Terminal::SnapshotFormat::PLAIN;
+        if (terminal.isExportingSnapshot())
         {
-            gRunning = false;
+            terminal.output("A snapshot is already being written to %s\n", snapshot._path.c_str());
+            return;
         }
+        snapshot._path = std::string{arguments[1]};
+        gt::Continuation const done{[](void* context)
+        {
+            auto const& state = *static_cast<SnapshotState*>(context);
+            state._terminal->output("Snapshot %s %s\n", state._path.c_str(), state._success ? "written" : "failed");
+        }, &snapshot};
+        (void) terminal.exportSnapshot(snapshot._path, format, done, &snapshot._success);
     });
-    terminal.addElement<gt::Banner>("This is a test program ! With an interactive, thread safe terminal");
+#ifndef _WIN32
+    //Open a second console on another tty, run `tty; sleep infinity` in another window to get one
+    std::vector<std::pair<std::unique_ptr<gt::Terminal>, int> > consoles;
+    commands.addCommand("console", [&](gt::CommandRegistry::Arguments const& arguments)
+    {
+        if (arguments.size() != 2)
+        {
+            return;
+        }
+        std::string const path{arguments[1]};
+
+        int const desc = open(path.c_str(), O_RDWR | O_NOCTTY);
+        auto console = std::make_unique<gt::Terminal>();
+        if (desc == -1 || !console->init(desc, desc))
+        {
+            terminal.output("Failed to open a console on %s\n", path.c_str());
+            if (desc != -1)
+            {
+                close(desc);
+            }
+            return;
+        }
 
-    terminal.setRowOffset(1);
+        console->getRootRegion()->addRegion(1)->setElement(console->addElement<gt::Banner>("Console " + path));
+        console->getRootRegion()->addRegion()->setElement(console->addElement<gt::TextOutputStream>());
+        auto* consoleInput = console->addElement<gt::TextInputStream>();
+        consoleInput->_onInput.add([&terminal, path](std::string_view line)
+        {
+            terminal.output("[%s] %.*s\n", path.c_str(), static_cast<int>(line.size()), line.data());
+        });
+
+        loop.addTerminal(console.get());
+        consoles.emplace_back(std::move(console), desc);
+        terminal.output("Console opened on %s\n", path.c_str());
+    });
+#endif //_WIN32
+    commands.addCompletion("hello");
+    commands.addCompletion("world");
+
+    auto* input = terminal.addElement<gt::TextInputStream>();
+    input->setCommandRegistry(&commands);
+#ifdef GTERMINAL_COROUTINES
+    commands.addCommand("greet", [&](gt::CommandRegistry::Arguments const&){ greet(terminal, *input); });
+#endif //GTERMINAL_COROUTINES
+    gProgress = terminal.addElement<gt::ProgressBar>(100, "Progress");
+
+    header->setElement(terminal.addElement<gt::Banner>("This is a test program ! With an interactive, thread safe terminal"));
 
     std::cout << "hello guys !" << std::endl;
     std::cout << "This text is coming from std::cout" << std::endl;
@@ -51,17 +184,19 @@ int main(int argc, char** argv)
     std::thread thread1(threadTest, &terminal);
     std::thread thread2(threadTest, &terminal);
 
-    while(gRunning)
-    {
-        terminal.update();
-
-        terminal.render();
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    loop.run();
 
     thread1.join();
     thread2.join();
 
+#ifndef _WIN32
+    for (auto& console : consoles)
+    {
+        loop.removeTerminal(console.first.get());
+        console.first.reset();
+        close(console.second);
+    }
+#endif //_WIN32
+
     return 0;
 }